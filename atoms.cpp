@@ -0,0 +1,36 @@
+#include "atoms.hpp"
+#include <algorithm>
+#include "xconnection.hpp"
+using namespace std;
+
+AtomRegistry::AtomRegistry() {
+    atoms_.fill(None);
+    for (size_t i = 0; i < ATOM_COUNT; ++i) {
+        sorted_[i] = make_pair(None, static_cast<AtomId>(i));
+    }
+}
+
+void AtomRegistry::Resolve(XConnection& connection) {
+    const vector<Atom> atoms = connection.InternAtoms(vector<string>(ATOM_NAMES, ATOM_NAMES + ATOM_COUNT));
+    for (size_t i = 0; i < ATOM_COUNT; ++i) {
+        atoms_[i] = atoms[i];
+        sorted_[i] = make_pair(atoms[i], static_cast<AtomId>(i));
+    }
+    sort(sorted_.begin(), sorted_.end(), [](const pair<Atom, AtomId>& a, const pair<Atom, AtomId>& b) {
+        return a.first < b.first;
+    });
+}
+
+bool AtomRegistry::Find(Atom atom, AtomId* id) const {
+    if (atom == None) {
+        return false;
+    }
+    const auto i = lower_bound(sorted_.begin(), sorted_.end(), atom, [](const pair<Atom, AtomId>& entry, Atom atom) {
+        return entry.first < atom;
+    });
+    if (i == sorted_.end() || i->first != atom) {
+        return false;
+    }
+    *id = i->second;
+    return true;
+}
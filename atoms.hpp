@@ -0,0 +1,61 @@
+#ifndef ATOMS_HPP
+#define ATOMS_HPP
+#include <array>
+#include <cstddef>
+#include <utility>
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+class XConnection;
+
+// Every atom the WM uses, as X(id, name). A new ICCCM or EWMH feature adds
+// its atoms here and gets them interned with all the others, so startup
+// stays at one round trip however long the list grows.
+#define LIGHTWM_ATOMS(X) \
+	X(WM_PROTOCOLS, "WM_PROTOCOLS") \
+	X(WM_DELETE_WINDOW, "WM_DELETE_WINDOW") \
+	X(NET_WM_SYNC_REQUEST, "_NET_WM_SYNC_REQUEST") \
+	X(NET_WM_SYNC_REQUEST_COUNTER, "_NET_WM_SYNC_REQUEST_COUNTER") \
+	X(NET_WM_NAME, "_NET_WM_NAME") \
+	X(NET_SUPPORTED, "_NET_SUPPORTED") \
+	X(NET_SUPPORTING_WM_CHECK, "_NET_SUPPORTING_WM_CHECK") \
+	X(NET_CLIENT_LIST, "_NET_CLIENT_LIST") \
+	X(NET_ACTIVE_WINDOW, "_NET_ACTIVE_WINDOW") \
+	X(UTF8_STRING, "UTF8_STRING")
+
+enum class AtomId {
+#define LIGHTWM_ATOM_ID(id, name) id,
+	LIGHTWM_ATOMS(LIGHTWM_ATOM_ID)
+#undef LIGHTWM_ATOM_ID
+};
+
+#define LIGHTWM_ATOM_ONE(id, name) + 1
+constexpr size_t ATOM_COUNT = 0 LIGHTWM_ATOMS(LIGHTWM_ATOM_ONE);
+#undef LIGHTWM_ATOM_ONE
+
+#define LIGHTWM_ATOM_NAME(id, name) name,
+constexpr const char* ATOM_NAMES[ATOM_COUNT] = {LIGHTWM_ATOMS(LIGHTWM_ATOM_NAME)};
+#undef LIGHTWM_ATOM_NAME
+
+constexpr const char* AtomName(AtomId id) { return ATOM_NAMES[static_cast<size_t>(id)]; }
+
+// The server's Atom for every AtomId, plus the reverse lookup for
+// dispatching on a property or message type. Holds None for everything
+// until Resolve.
+class AtomRegistry {
+	public:
+		AtomRegistry();
+		// Interns the whole list in one batched request.
+		void Resolve(XConnection& connection);
+		Atom operator[](AtomId id) const { return atoms_[static_cast<size_t>(id)]; }
+		// False for atoms that are not in the list. A binary search over
+		// ATOM_COUNT entries, no hashing.
+		bool Find(Atom atom, AtomId* id) const;
+
+	private:
+		std::array<Atom, ATOM_COUNT> atoms_;
+		// By Atom, for Find.
+		std::array<std::pair<Atom, AtomId>, ATOM_COUNT> sorted_;
+};
+#endif
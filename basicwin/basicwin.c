@@ -4,6 +4,9 @@
 #include <X11/Xatom.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
 #include "bitmaps/icon_bitmap"
 #include "basicwin.h"
 
@@ -17,7 +20,66 @@ int screen_num;
 
 static char* progname;
 
-void main(argc, argv)
+/* Load generator settings, see usage(). */
+struct load_options {
+	int windows;
+	double rate;
+	int configure_flood;
+	int churn_properties;
+	double seconds;
+};
+
+static void run_demo(int argc, char** argv);
+static void run_load(struct load_options* options);
+
+static void usage()
+{
+	fprintf(stderr, "usage: %s                      (one demo window)\n", progname);
+	fprintf(stderr, "       %s -n windows [-r ops/s] [-c configures] [-p] [-d seconds]\n", progname);
+	fprintf(stderr, "  -n  windows created on this one connection\n");
+	fprintf(stderr, "  -r  map/unmap operations per second, round robin over the windows (default 100)\n");
+	fprintf(stderr, "  -c  ConfigureRequests sent to a mapped window per operation (default 0)\n");
+	fprintf(stderr, "  -p  also change WM_NAME and WM_CLASS of a window per operation\n");
+	fprintf(stderr, "  -d  run time in seconds (default 10)\n");
+	fprintf(stderr, "Prints one JSON object with map request to MapNotify latencies.\n");
+	exit(2);
+}
+
+int main(argc, argv)
+int argc;
+char** argv;
+{
+	struct load_options options = {0, 100.0, 0, 0, 10.0};
+	int i;
+
+	progname = argv[0];
+	if (argc == 1) {
+		run_demo(argc, argv);
+		return 0;
+	}
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0) {
+			options.churn_properties = 1;
+		} else if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+			options.windows = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(argv[i], "-r") == 0) {
+			options.rate = atof(argv[++i]);
+		} else if (i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+			options.configure_flood = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+			options.seconds = atof(argv[++i]);
+		} else {
+			usage();
+		}
+	}
+	if (options.windows <= 0 || options.rate <= 0 || options.seconds <= 0) {
+		usage();
+	}
+	run_load(&options);
+	return 0;
+}
+
+static void run_demo(argc, argv)
 int argc;
 char** argv;
 {
@@ -42,8 +104,6 @@ char** argv;
 	char* display_name = NULL;
 	int window_size = 0;
 
-	progname = argv[0];
-
 	if (!(size_hints = XAllocSizeHints())) {
 		fprintf(stderr, "%s: failure to allocate memory\n", progname);
 		exit(0);
@@ -245,3 +305,163 @@ XFontStruct* font_info;
 	x_offset = 2;
 	XDrawString(display,win,gc,x_offset,y_offset,string1,strlen(string1));
 }
+
+/* Load generator. All windows live on this one connection; every operation
+ * toggles the next window in turn between mapped and unmapped, so a window
+ * manager sees a steady stream of MapRequests and UnmapNotifys. The time from
+ * each XMapWindow to the matching MapNotify is what a user would feel as the
+ * window manager's map latency. */
+
+static double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(a, b)
+const void* a;
+const void* b;
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(samples, count, p)
+double* samples;
+int count;
+double p;
+{
+	if (count == 0) {
+		return 0;
+	}
+	return samples[(int) (p * (count - 1))];
+}
+
+static void change_properties(win, serial)
+Window win;
+unsigned long serial;
+{
+	char title[64];
+	XClassHint class_hint;
+	snprintf(title, sizeof(title), "basicwin load %lu", serial);
+	XStoreName(display, win, title);
+	class_hint.res_name = (serial & 1) ? "basicwin-odd" : "basicwin-even";
+	class_hint.res_class = "Basicwin";
+	XSetClassHint(display, win, &class_hint);
+}
+
+static void run_load(options)
+struct load_options* options;
+{
+	Window* windows;
+	double* mapped_at;
+	double* latencies;
+	int latency_count = 0, latency_capacity = 1024;
+	unsigned long operations = 0, maps = 0, unmaps = 0, configures = 0, property_changes = 0;
+	int pending = 0;
+	double start, end, now, deadline;
+	struct pollfd pfd;
+	XEvent report;
+	int i, j, k;
+
+	if ((display = XOpenDisplay(NULL)) == NULL) {
+		(void) fprintf(stderr, "%s: Cannot connect to X server display named %s\n", progname, XDisplayName(NULL));
+		exit(-1);
+	}
+	screen_num = DefaultScreen(display);
+	windows = malloc(options->windows * sizeof(Window));
+	mapped_at = calloc(options->windows, sizeof(double));
+	latencies = malloc(latency_capacity * sizeof(double));
+	if (!windows || !mapped_at || !latencies) {
+		fprintf(stderr, "%s: failure to allocate memory\n", progname);
+		exit(0);
+	}
+	for (i = 0; i < options->windows; i++) {
+		windows[i] = XCreateSimpleWindow(display, RootWindow(display, screen_num),
+			(i * 37) % (DisplayWidth(display, screen_num) - 200), (i * 23) % (DisplayHeight(display, screen_num) - 150),
+			200, 150, 1, BlackPixel(display, screen_num), WhitePixel(display, screen_num));
+		XSelectInput(display, windows[i], StructureNotifyMask);
+		change_properties(windows[i], (unsigned long) i);
+	}
+	XSync(display, False);
+
+	pfd.fd = ConnectionNumber(display);
+	pfd.events = POLLIN;
+	start = now_seconds();
+	end = start + options->seconds;
+	/* Run the operations, then give outstanding maps a second to complete. */
+	for (now = start; now < end || (pending > 0 && now < end + 1.0); now = now_seconds()) {
+		while (now < end && operations < (unsigned long) ((now - start) * options->rate)) {
+			i = operations % options->windows;
+			if (mapped_at[i] == 0) {
+				mapped_at[i] = now_seconds();
+				XMapWindow(display, windows[i]);
+				maps++;
+				pending++;
+			} else {
+				/* A still pending map is dropped rather than timed late. */
+				if (mapped_at[i] > 0) {
+					pending--;
+				}
+				mapped_at[i] = 0;
+				XUnmapWindow(display, windows[i]);
+				unmaps++;
+			}
+			/* Flood a window that is (or is about to be) mapped. */
+			j = (i + options->windows / 2) % options->windows;
+			for (k = 0; k < options->configure_flood; k++) {
+				XMoveResizeWindow(display, windows[j], (k * 7) % 400, (k * 5) % 300, 150 + k % 100, 100 + k % 80);
+				configures++;
+			}
+			if (options->churn_properties) {
+				change_properties(windows[j], operations);
+				property_changes++;
+			}
+			operations++;
+		}
+		XFlush(display);
+		/* Sleep until the next operation is due or the server talks. */
+		deadline = now < end ? start + (operations + 1) / options->rate : end + 1.0;
+		if (XPending(display) == 0) {
+			pfd.revents = 0;
+			poll(&pfd, 1, (int) ((deadline - now) * 1000) + 1);
+		}
+		while (XPending(display) > 0) {
+			XNextEvent(display, &report);
+			if (report.type != MapNotify) {
+				continue;
+			}
+			for (i = 0; i < options->windows && windows[i] != report.xmap.window; i++) {
+			}
+			if (i == options->windows || mapped_at[i] <= 0) {
+				continue;
+			}
+			if (latency_count == latency_capacity) {
+				latency_capacity *= 2;
+				latencies = realloc(latencies, latency_capacity * sizeof(double));
+				if (!latencies) {
+					fprintf(stderr, "%s: failure to allocate memory\n", progname);
+					exit(0);
+				}
+			}
+			latencies[latency_count++] = (now_seconds() - mapped_at[i]) * 1e6;
+			/* Mapped and answered: the next toggle unmaps it. */
+			mapped_at[i] = -1;
+			pending--;
+		}
+	}
+
+	qsort(latencies, latency_count, sizeof(double), compare_doubles);
+	printf("{\"windows\": %d, \"seconds\": %.3f, \"maps\": %lu, \"unmaps\": %lu, \"configure_requests\": %lu, "
+		"\"property_changes\": %lu, \"map_notifies\": %d, \"unanswered_maps\": %d, "
+		"\"map_latency_us\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}}\n",
+		options->windows, options->seconds, maps, unmaps, configures, property_changes, latency_count, pending,
+		percentile(latencies, latency_count, 0.5), percentile(latencies, latency_count, 0.9),
+		percentile(latencies, latency_count, 0.99), percentile(latencies, latency_count, 1.0));
+	free(latencies);
+	free(mapped_at);
+	free(windows);
+	XCloseDisplay(display);
+}
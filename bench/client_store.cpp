@@ -0,0 +1,137 @@
+// Compares the WM's ClientStore with the unordered_map bookkeeping it
+// replaced (client map plus frame-to-client map) at several client counts.
+// Window ids are allocated the way the server does it: one resource id base
+// per connection, sequential ids within it.
+//
+//   bench/client_store [-r rounds]
+//
+// Prints one JSON object per client count with nanoseconds per operation.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "../clientstore.hpp"
+using namespace std;
+
+struct MapClient {
+    Window window;
+    Window frame;
+    CachedWindow geometry;
+    CachedWindow frame_geometry;
+    vector<Atom> protocols;
+};
+
+struct MapStore {
+    unordered_map<Window, MapClient> clients;
+    unordered_map<Window, Window> frames;
+};
+
+/* Defeats dead-code elimination of the lookups. */
+static volatile unsigned long sink;
+
+static double NsPer(chrono::steady_clock::time_point start, size_t operations) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / operations;
+}
+
+static vector<Window> WindowIds(size_t count, mt19937& rng) {
+    vector<Window> ids;
+    for (size_t i = 0; i < count; ++i) {
+        /* A handful of client connections, each with its own id base. */
+        const Window base = static_cast<Window>(i % 8 + 1) << 21;
+        ids.push_back(base | (i / 8 * 3 + 1));
+    }
+    shuffle(ids.begin(), ids.end(), rng);
+    return ids;
+}
+
+static void Run(size_t count, int rounds) {
+    mt19937 rng(count);
+    const vector<Window> windows = WindowIds(count, rng);
+    vector<Window> frames;
+    for (Window w : windows) {
+        frames.push_back(w | 0x100000);
+    }
+    /* Lookups hit clients in random order, half by window and half by frame. */
+    vector<size_t> probes(1 << 16);
+    for (size_t& p : probes) {
+        p = rng() % count;
+    }
+    const size_t lookups = probes.size() * rounds;
+
+    ClientStore store;
+    MapStore maps;
+    for (size_t i = 0; i < count; ++i) {
+        store.Insert(windows[i], frames[i]);
+        MapClient& client = maps.clients[windows[i]];
+        client.window = windows[i];
+        client.frame = frames[i];
+        maps.frames[frames[i]] = windows[i];
+    }
+
+    auto start = chrono::steady_clock::now();
+    unsigned long sum = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t k = 0; k < probes.size(); ++k) {
+            const Client* client = k & 1 ? store.FindByFrame(frames[probes[k]]) : store.Find(windows[probes[k]]);
+            sum += client->window;
+        }
+    }
+    const double store_lookup = NsPer(start, lookups);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t k = 0; k < probes.size(); ++k) {
+            Window w = windows[probes[k]];
+            if (k & 1) {
+                w = maps.frames.find(frames[probes[k]])->second;
+            }
+            sum += maps.clients.find(w)->second.window;
+        }
+    }
+    const double map_lookup = NsPer(start, lookups);
+    sink = sum;
+
+    /* Churn: remove and re-add every client, as windows come and go. */
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            store.Erase(windows[i]);
+            store.Insert(windows[i], frames[i]);
+        }
+    }
+    const double store_churn = NsPer(start, count * rounds);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            maps.clients.erase(windows[i]);
+            maps.frames.erase(frames[i]);
+            MapClient& client = maps.clients[windows[i]];
+            client.window = windows[i];
+            client.frame = frames[i];
+            maps.frames[frames[i]] = windows[i];
+        }
+    }
+    const double map_churn = NsPer(start, count * rounds);
+
+    cout << "{\"clients\": " << count
+         << ", \"store_lookup_ns\": " << store_lookup << ", \"unordered_map_lookup_ns\": " << map_lookup
+         << ", \"store_churn_ns\": " << store_churn << ", \"unordered_map_churn_ns\": " << map_churn << "}" << endl;
+}
+
+int main(int argc, char** argv) {
+    int rounds = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0) {
+            rounds = max(1, atoi(argv[i + 1]));
+        }
+    }
+    for (size_t count : {10, 100, 1000, 10000}) {
+        Run(count, rounds);
+    }
+    return 0;
+}
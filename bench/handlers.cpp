@@ -0,0 +1,256 @@
+// Runs the window manager's event handlers against the in-memory
+// FakeXServer, so their cost is measured without a display or the X
+// server's scheduling noise. Every event the fake server sends back (the
+// MapNotify after a frame is mapped, ...) is handled too, as it would be
+// live. Also checks that the window tree ends up as expected.
+//
+//   bench/handlers [-n clients] [-r repetitions]
+//
+// Scenarios: map, configure_request, property_notify, focus, motion and
+// unmap_destroy. Prints one JSON object per scenario with nanoseconds, X requests and
+// round trips per operation; "errors" counts requests that named a missing
+// window. Round trips are audited per handler, and a handler that waits on
+// the server more often than its budget fails the run, and so does an EWMH
+// client list or active window on the root that does not match the clients.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "../fakexserver.hpp"
+#include "../roundtrip.hpp"
+#include "../winman.hpp"
+extern "C" {
+#include <X11/Xatom.h>
+}
+using namespace std;
+
+static double NsPer(chrono::steady_clock::time_point start, size_t operations) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / operations;
+}
+
+/* Handles everything the fake server has queued as one batch, like
+ * ProcessXEvents, then whatever that batch caused. */
+static void Drain(FakeXServer& server, WindowManager& wm) {
+    while (server.Pending()) {
+        vector<XEvent> batch(server.Pending());
+        for (XEvent& event : batch) {
+            server.NextEvent(&event);
+        }
+        wm.HandleEvents(batch);
+    }
+}
+
+static unsigned long TotalRoundTrips(const AuditingConnection& audit) {
+    unsigned long count = 0;
+    for (const auto& handler : audit.report()) {
+        count += audit.RoundTrips(handler.first);
+    }
+    return count;
+}
+
+static void Report(const char* scenario, size_t clients, double ns, unsigned long requests, size_t operations,
+                   const FakeXServer& server, const AuditingConnection& audit) {
+    cout << "{\"scenario\": \"" << scenario << "\", \"clients\": " << clients << ", \"ns_per_op\": " << ns
+         << ", \"requests_per_op\": " << static_cast<double>(requests) / operations
+         << ", \"round_trips_per_op\": " << static_cast<double>(TotalRoundTrips(audit)) / operations
+         << ", \"errors\": " << server.errors() << "}" << endl;
+}
+
+/* The handlers' logging is off while the scenarios run. */
+static bool Fail(const string& message) {
+    cerr.clear();
+    cerr << message << endl;
+    return false;
+}
+
+/* Fails unless every handler of a scenario stayed within its round trip
+ * budget, then starts the next scenario's count from zero. */
+static bool CheckRoundTrips(const char* scenario, AuditingConnection& audit, const map<string, unsigned long>& budgets) {
+    bool ok = true;
+    for (const auto& handler : audit.report()) {
+        const auto budget = budgets.find(handler.first);
+        const unsigned long allowed = budget == budgets.end() ? 0 : budget->second;
+        const unsigned long count = audit.RoundTrips(handler.first);
+        if (count > allowed) {
+            ok = Fail(string(scenario) + ": " + handler.first + " made " + to_string(count) +
+                      " round trips, at most " + to_string(allowed) + " expected");
+        }
+    }
+    audit.Reset();
+    return ok;
+}
+
+static XEvent Pointer(int type, Window frame, int x, int y, unsigned int state) {
+    XEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.xbutton.subwindow = frame;
+    event.xbutton.x_root = x;
+    event.xbutton.y_root = y;
+    event.xbutton.state = state;
+    event.xbutton.button = Button1;
+    return event;
+}
+
+static bool Run(size_t count, int repetitions) {
+    FakeXServer* server = new FakeXServer();
+    AuditingConnection* audit = new AuditingConnection(unique_ptr<XConnection>(server));
+    unique_ptr<WindowManager> wm(WindowManager::Create(unique_ptr<XConnection>(audit)));
+    /* What Run does on startup. */
+    server->SelectInput(server->root(), SubstructureRedirectMask | SubstructureNotifyMask);
+    wm->StartEwmh();
+    const Atom wm_delete_window = server->InternAtoms({"WM_DELETE_WINDOW"})[0];
+    const Atom net_wm_name = server->InternAtoms({"_NET_WM_NAME"})[0];
+    const Atom net_client_list = server->InternAtoms({"_NET_CLIENT_LIST"})[0];
+    const Atom net_active_window = server->InternAtoms({"_NET_ACTIVE_WINDOW"})[0];
+    audit->Reset();
+
+    vector<Window> clients;
+    unsigned long requests = server->requests();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        const Window w = server->ClientCreateWindow(i % 1000, i % 700, 400, 300);
+        server->ClientSetClass(w, "client", "Client");
+        server->ClientSetProtocols(w, {wm_delete_window});
+        server->ClientMapWindow(w);
+        Drain(*server, *wm);
+        clients.push_back(w);
+    }
+    Report("map", count, NsPer(start, count), server->requests() - requests, count, *server, *audit);
+    /* The batched FetchWindowInfo of each new client. */
+    if (!CheckRoundTrips("map", *audit, {{"OnMapRequest", count}})) {
+        return false;
+    }
+    for (Window w : clients) {
+        const Window frame = server->Parent(w);
+        if (frame == server->root() || !server->Mapped(frame) || !server->Mapped(w)) {
+            return Fail("Window " + to_string(w) + " was not framed");
+        }
+    }
+    if (server->Property32(server->root(), net_client_list) != vector<unsigned long>(clients.begin(), clients.end())) {
+        return Fail("_NET_CLIENT_LIST does not list the clients in mapping order");
+    }
+
+    /* Clients asking to move and resize themselves. */
+    const size_t configures = count * repetitions;
+    requests = server->requests();
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < configures; ++i) {
+        XWindowChanges changes;
+        changes.x = i % 800;
+        changes.y = i % 600;
+        changes.width = 200 + i % 400;
+        changes.height = 150 + i % 300;
+        server->ClientConfigureWindow(clients[i % count], CWX | CWY | CWWidth | CWHeight, changes);
+        Drain(*server, *wm);
+    }
+    Report("configure_request", count, NsPer(start, configures), server->requests() - requests, configures, *server, *audit);
+    if (!CheckRoundTrips("configure_request", *audit, {})) {
+        return false;
+    }
+
+    /* Clients retitling themselves and changing their hints. The changes
+     * one batch of events announces are fetched back together. */
+    const size_t retitles = count * repetitions;
+    requests = server->requests();
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < retitles; ++i) {
+        const Window w = clients[i % count];
+        const string title = "client " + to_string(i);
+        const long hints[9] = {InputHint | StateHint, True, NormalState};
+        server->ClientSetProperty(w, XA_WM_NAME, XA_STRING, 8, title.data(), title.size());
+        server->ClientSetProperty(w, net_wm_name, XA_STRING, 8, title.data(), title.size());
+        server->ClientSetProperty(w, XA_WM_HINTS, XA_WM_HINTS, 32, hints, 9);
+        Drain(*server, *wm);
+    }
+    Report("property_notify", count, NsPer(start, retitles), server->requests() - requests, retitles, *server, *audit);
+    if (!CheckRoundTrips("property_notify", *audit, {{"RefreshProperties", retitles}})) {
+        return false;
+    }
+
+    /* Clients taking the focus; _NET_ACTIVE_WINDOW follows. */
+    const size_t focuses = count * repetitions;
+    requests = server->requests();
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < focuses; ++i) {
+        server->ClientSetInputFocus(clients[(i * 7) % count]);
+        Drain(*server, *wm);
+    }
+    Report("focus", count, NsPer(start, focuses), server->requests() - requests, focuses, *server, *audit);
+    if (!CheckRoundTrips("focus", *audit, {})) {
+        return false;
+    }
+    const vector<unsigned long> active = server->Property32(server->root(), net_active_window);
+    if (active.size() != 1 || active[0] != server->focus()) {
+        return Fail("_NET_ACTIVE_WINDOW is not the focused client");
+    }
+
+    /* An ALT-drag of one frame, snapping included. */
+    const size_t motions = 1000 * repetitions;
+    const Window frame = server->Parent(clients[count / 2]);
+    const Rect before = server->Geometry(frame);
+    server->QueueEvent(Pointer(ButtonPress, frame, 500, 500, Mod1Mask));
+    Drain(*server, *wm);
+    audit->Reset();
+    requests = server->requests();
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < motions; ++i) {
+        server->QueueEvent(Pointer(MotionNotify, frame, 500 + i % 300, 500 + i % 200, Mod1Mask | Button1Mask));
+        Drain(*server, *wm);
+    }
+    Report("motion", count, NsPer(start, motions), server->requests() - requests, motions, *server, *audit);
+    if (!CheckRoundTrips("motion", *audit, {})) {
+        return false;
+    }
+    server->QueueEvent(Pointer(ButtonRelease, frame, 500, 500, Mod1Mask | Button1Mask));
+    Drain(*server, *wm);
+    if (server->Geometry(frame) == before) {
+        return Fail("The dragged frame did not move");
+    }
+    audit->Reset();
+
+    /* Clients going away; the frames must go with them. */
+    requests = server->requests();
+    start = chrono::steady_clock::now();
+    for (Window w : clients) {
+        server->ClientUnmapWindow(w);
+        Drain(*server, *wm);
+        server->ClientDestroyWindow(w);
+        Drain(*server, *wm);
+    }
+    Report("unmap_destroy", count, NsPer(start, count), server->requests() - requests, count, *server, *audit);
+    if (!CheckRoundTrips("unmap_destroy", *audit, {})) {
+        return false;
+    }
+    /* The root and the _NET_SUPPORTING_WM_CHECK window stay. */
+    if (server->window_count() != 2) {
+        return Fail(to_string(server->window_count() - 2) + " windows left over");
+    }
+    if (!server->Property32(server->root(), net_client_list).empty() ||
+        server->Property32(server->root(), net_active_window) != vector<unsigned long>{None}) {
+        return Fail("_NET_CLIENT_LIST or _NET_ACTIVE_WINDOW still names a client");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t clients = 0;
+    int repetitions = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            clients = max(1, atoi(argv[i + 1]));
+        } else if (strcmp(argv[i], "-r") == 0) {
+            repetitions = max(1, atoi(argv[i + 1]));
+        }
+    }
+    /* Every motion event is applied as it comes. */
+    setenv("LIGHTWM_MOTION_INTERVAL_MS", "0", 1);
+    bool ok = true;
+    for (size_t count : clients ? vector<size_t>{clients} : vector<size_t>{10, 100, 1000}) {
+        cerr.setstate(ios::badbit);
+        ok = Run(count, repetitions) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
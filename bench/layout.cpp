@@ -0,0 +1,90 @@
+// Measures the tiling layout alone, without an X server: the cost of the
+// relayout after a map, an unmap and a resize, against a full relayout,
+// for layouts of 10 to 10000 windows. Windows are inserted next to a
+// random existing one, as when the focused window is split.
+//
+//   bench/layout [-r repetitions]
+//
+// Prints one JSON object per window count with nanoseconds per operation
+// and the number of frames that would be reconfigured.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../layout.hpp"
+using namespace std;
+
+static const Rect SCREEN = {0, 0, 1920, 1080};
+
+static double NsPer(chrono::steady_clock::time_point start, size_t operations) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / operations;
+}
+
+static void Run(size_t count, int repetitions) {
+    mt19937 rng(count);
+    TilingLayout layout;
+    layout.SetArea(SCREEN);
+    vector<Window> windows;
+    for (size_t i = 0; i < count; ++i) {
+        const Window w = 0x200001 + i;
+        layout.Insert(w, windows.empty() ? None : windows[rng() % windows.size()]);
+        windows.push_back(w);
+    }
+    layout.Update();
+
+    /* Map then unmap one extra window next to a random one. */
+    size_t map_changes = 0;
+    size_t unmap_changes = 0;
+    double map_ns = 0;
+    double unmap_ns = 0;
+    for (int r = 0; r < repetitions; ++r) {
+        const Window extra = 0x400001 + r;
+        auto start = chrono::steady_clock::now();
+        layout.Insert(extra, windows[rng() % count]);
+        map_changes += layout.Update().size();
+        map_ns += NsPer(start, 1);
+        start = chrono::steady_clock::now();
+        layout.Remove(extra);
+        unmap_changes += layout.Update().size();
+        unmap_ns += NsPer(start, 1);
+    }
+
+    size_t resize_changes = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) {
+        layout.Resize(windows[rng() % count], Size<int>(100 + rng() % 800, 100 + rng() % 600));
+        resize_changes += layout.Update().size();
+    }
+    const double resize_ns = NsPer(start, repetitions);
+
+    /* Alternating screen sizes so every tile really changes. */
+    size_t full_changes = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) {
+        layout.SetArea(r & 1 ? SCREEN : Rect{0, 0, 1280, 1024});
+        full_changes += layout.Update().size();
+    }
+    const double full_ns = NsPer(start, repetitions);
+
+    cout << "{\"windows\": " << count
+         << ", \"map_ns\": " << map_ns / repetitions << ", \"map_frames\": " << double(map_changes) / repetitions
+         << ", \"unmap_ns\": " << unmap_ns / repetitions << ", \"unmap_frames\": " << double(unmap_changes) / repetitions
+         << ", \"resize_ns\": " << resize_ns << ", \"resize_frames\": " << double(resize_changes) / repetitions
+         << ", \"full_relayout_ns\": " << full_ns << ", \"full_relayout_frames\": " << double(full_changes) / repetitions
+         << "}" << endl;
+}
+
+int main(int argc, char** argv) {
+    int repetitions = 1000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0) {
+            repetitions = max(1, atoi(argv[i + 1]));
+        }
+    }
+    for (size_t count : {10, 100, 1000, 10000}) {
+        Run(count, repetitions);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Maps N client windows under a running LightWM and reports how long it took
+// for all of them to be framed and how much the X server's resident memory
+// grew. Passive grabs the WM installs per client show up as server memory;
+// with root-window grabs the growth per map should be frames only.
+//
+//   bench/map_grabs [-n windows] [-p xserver-pid] [-s socket]
+//
+// The X requests the WM sent per map come from its "stats" control command,
+// sampled before and after; -1 if the control socket cannot be reached.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+extern "C" {
+#include <X11/Xlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+#include "../control.hpp"
+using namespace std;
+
+/* X requests the WM has sent since it started, or -1. */
+static long WmRequests(const string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    char reply[256];
+    ssize_t length = -1;
+    if (send(fd, "stats\n", 6, 0) == 6) {
+        length = recv(fd, reply, sizeof(reply) - 1, 0);
+    }
+    close(fd);
+    if (length <= 0) {
+        return -1;
+    }
+    reply[length] = '\0';
+    long requests = -1;
+    return sscanf(reply, "ok events %*u requests %ld", &requests) == 1 ? requests : -1;
+}
+
+static long ServerRssKb(int pid) {
+    if (pid <= 0) {
+        return -1;
+    }
+    ifstream status("/proc/" + to_string(pid) + "/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    int count = 500;
+    int server_pid = 0;
+    string socket_path = DefaultControlSocketPath(nullptr);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            server_pid = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            socket_path = argv[i + 1];
+        }
+    }
+    Display* display = XOpenDisplay(nullptr);
+    if (display == nullptr) {
+        cerr << "Failed to open X Display" << endl;
+        return 1;
+    }
+    const Window root = DefaultRootWindow(display);
+    vector<Window> windows;
+    for (int i = 0; i < count; ++i) {
+        const Window w = XCreateSimpleWindow(display, root, (i * 7) % 600, (i * 5) % 400, 100, 80, 0, 0, 0xffffff);
+        XSelectInput(display, w, StructureNotifyMask);
+        windows.push_back(w);
+    }
+    XSync(display, false);
+    const long rss_before = ServerRssKb(server_pid);
+    const long requests_before = WmRequests(socket_path);
+
+    const auto start = chrono::steady_clock::now();
+    for (Window w : windows) {
+        XMapWindow(display, w);
+    }
+    XFlush(display);
+    int framed = 0;
+    while (framed < count) {
+        XEvent event;
+        XNextEvent(display, &event);
+        if (event.type == ReparentNotify && event.xreparent.parent != root) {
+            ++framed;
+        }
+    }
+    const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    XSync(display, false);
+    const long rss_after = ServerRssKb(server_pid);
+    const long requests_after = WmRequests(socket_path);
+    const double requests_per_map = requests_before >= 0 && requests_after >= 0 ?
+        static_cast<double>(requests_after - requests_before) / max(count, 1) : -1;
+
+    cout << "{\"windows\": " << count
+         << ", \"map_us\": " << elapsed.count()
+         << ", \"us_per_map\": " << elapsed.count() / max(count, 1)
+         << ", \"requests_per_map\": " << requests_per_map
+         << ", \"server_rss_kb_before\": " << rss_before
+         << ", \"server_rss_kb_after\": " << rss_after << "}" << endl;
+    XCloseDisplay(display);
+    return 0;
+}
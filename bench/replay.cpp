@@ -0,0 +1,25 @@
+// Replays an event recording made with LIGHTWM_RECORD=<file> through the
+// window manager's handlers as fast as they run, for comparing builds on
+// real traffic.
+//
+//   bench/replay <recording> [display]
+//
+// The handlers talk to the given display (default $DISPLAY) without taking
+// it over, so point it at a private Xvfb. Prints one JSON object per event
+// type with handler time, then a summary.
+#include <cstdlib>
+#include <iostream>
+#include "../winman.hpp"
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        cerr << "usage: " << argv[0] << " <recording> [display]" << endl;
+        return EXIT_FAILURE;
+    }
+    unique_ptr<WindowManager> window_manager(WindowManager::Create(argc == 3 ? argv[2] : ""));
+    if (!window_manager) {
+        return EXIT_FAILURE;
+    }
+    return window_manager->Replay(argv[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
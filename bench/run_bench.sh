@@ -0,0 +1,42 @@
+#!/bin/sh
+# Starts a private Xvfb, runs lightwm on it and drives bench/scenarios
+# against it. Used by "scons bench"; the JSON results go to $1 (default
+# bench_results.json) and the WM's log to bench_lightwm.log. Afterwards
+# bench/basicwin puts sustained map/unmap, configure and property load on the
+# same WM and writes its latencies to bench_load.json.
+#
+# BENCH_WINDOWS sets the number of client windows (default 200).
+set -e
+OUT=${1:-bench_results.json}
+WINDOWS=${BENCH_WINDOWS:-200}
+
+NUM=90
+while [ -e /tmp/.X11-unix/X$NUM ] || [ -e /tmp/.X$NUM-lock ]; do
+    NUM=$((NUM + 1))
+done
+DISPLAY=:$NUM
+export DISPLAY
+SOCKET=/tmp/lightwm-bench-$$.sock
+
+Xvfb $DISPLAY -screen 0 1920x1080x24 -nolisten tcp > /dev/null 2>&1 &
+XVFB_PID=$!
+WM_PID=
+trap 'kill $WM_PID $XVFB_PID 2> /dev/null; rm -f $SOCKET' EXIT
+for i in $(seq 50); do
+    [ -e /tmp/.X11-unix/X$NUM ] && break
+    sleep 0.1
+done
+
+# Snapping would move the dragged frame off the path the driver expects.
+LIGHTWM_SOCKET=$SOCKET LIGHTWM_SNAP_DISTANCE=0 ./lightwm > /dev/null 2> bench_lightwm.log &
+WM_PID=$!
+for i in $(seq 50); do
+    [ -e $SOCKET ] && break
+    sleep 0.1
+done
+
+LABEL=$(git rev-parse --short HEAD 2> /dev/null || echo unknown)
+bench/scenarios -n $WINDOWS -s $SOCKET -l $LABEL > $OUT
+cat $OUT
+bench/basicwin -n $WINDOWS -r 500 -c 20 -p -d 5 > bench_load.json
+cat bench_load.json
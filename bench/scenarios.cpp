@@ -0,0 +1,315 @@
+// Scripted scenarios against a running LightWM; "scons bench" runs this on a
+// private Xvfb through bench/run_bench.sh.
+//
+//   bench/scenarios [-n windows] [-s socket] [-l label]
+//
+// Scenarios: mapping and unmapping N windows one at a time (latency until
+// framed / handed back), mapping N at once, a sustained ALT-drag, a storm of
+// ConfigureRequests and ALT+Tab across all N clients. The drag and ALT+Tab
+// inject input through XTEST. For every scenario the WM's "stats" control
+// command is sampled before and after, which gives events processed per
+// second and X requests per event. Prints one JSON object.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+#include "../control.hpp"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const int TIMEOUT_MS = 5000;
+
+struct WmStats {
+    unsigned long events;
+    unsigned long requests;
+    unsigned long busy_us;
+};
+
+static bool QueryStats(const string& path, WmStats* stats) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    char reply[256];
+    ssize_t length = -1;
+    if (send(fd, "stats\n", 6, 0) == 6) {
+        length = recv(fd, reply, sizeof(reply) - 1, 0);
+    }
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    reply[length] = '\0';
+    return sscanf(reply, "ok events %lu requests %lu busy_us %lu", &stats->events, &stats->requests, &stats->busy_us) == 3;
+}
+
+/* Wall time and WM counters over one scenario. */
+class Scenario {
+    public:
+        Scenario(const string& socket_path) : socket_path_(socket_path), start_(Clock::now()), start_stats_{0, 0, 0} {
+            QueryStats(socket_path_, &start_stats_);
+        }
+        // The common fields, as the start of a JSON object body.
+        string Finish() {
+            const double seconds = chrono::duration<double>(Clock::now() - start_).count();
+            WmStats end{0, 0, 0};
+            QueryStats(socket_path_, &end);
+            /* The two stats commands themselves send no X requests. */
+            const unsigned long events = end.events - start_stats_.events;
+            const unsigned long requests = end.requests - start_stats_.requests;
+            ostringstream out;
+            out << "\"seconds\": " << seconds << ", \"events\": " << events
+                << ", \"events_per_sec\": " << (seconds > 0 ? events / seconds : 0)
+                << ", \"requests_per_event\": " << (events ? double(requests) / events : 0)
+                << ", \"wm_busy_ms\": " << (end.busy_us - start_stats_.busy_us) / 1000.0;
+            return out.str();
+        }
+
+    private:
+        string socket_path_;
+        Clock::time_point start_;
+        WmStats start_stats_;
+};
+
+static string Percentiles(vector<double> samples) {
+    ostringstream out;
+    if (samples.empty()) {
+        out << "{}";
+        return out.str();
+    }
+    sort(samples.begin(), samples.end());
+    const auto at = [&samples](double p) { return samples[min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+    out << "{\"p50\": " << at(0.5) << ", \"p90\": " << at(0.9) << ", \"p99\": " << at(0.99) << ", \"max\": " << samples.back() << "}";
+    return out.str();
+}
+
+/* Reads events until one matches, for up to timeout_ms. Other events are
+ * dropped. */
+template <typename Predicate>
+static bool WaitForEvent(Display* display, Predicate matches, int timeout_ms = TIMEOUT_MS) {
+    const auto deadline = Clock::now() + chrono::milliseconds(timeout_ms);
+    XEvent event;
+    while (true) {
+        while (XPending(display)) {
+            XNextEvent(display, &event);
+            if (matches(event)) {
+                return true;
+            }
+        }
+        const auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now()).count();
+        if (remaining <= 0) {
+            return false;
+        }
+        struct pollfd fd = {ConnectionNumber(display), POLLIN, 0};
+        poll(&fd, 1, remaining);
+    }
+}
+
+static double MicrosecondsSince(Clock::time_point start) {
+    return chrono::duration<double, micro>(Clock::now() - start).count();
+}
+
+static Window FrameOf(Display* display, Window w) {
+    Window root, parent;
+    Window* children = nullptr;
+    unsigned int count;
+    if (!XQueryTree(display, w, &root, &parent, &children, &count)) {
+        return None;
+    }
+    if (children) {
+        XFree(children);
+    }
+    return parent;
+}
+
+static string MapOneByOne(Display* display, const vector<Window>& windows, const string& socket_path) {
+    Scenario scenario(socket_path);
+    vector<double> latencies;
+    unsigned int timeouts = 0;
+    for (Window w : windows) {
+        const auto start = Clock::now();
+        XMapWindow(display, w);
+        XFlush(display);
+        /* Framed once the WM has reparented and mapped it. */
+        if (WaitForEvent(display, [w](const XEvent& e) { return e.type == MapNotify && e.xmap.window == w; })) {
+            latencies.push_back(MicrosecondsSince(start));
+        } else {
+            ++timeouts;
+        }
+    }
+    return "{" + scenario.Finish() + ", \"map_to_frame_us\": " + Percentiles(latencies) + ", \"timeouts\": " + to_string(timeouts) + "}";
+}
+
+static string UnmapOneByOne(Display* display, const vector<Window>& windows, const string& socket_path) {
+    const Window root = DefaultRootWindow(display);
+    Scenario scenario(socket_path);
+    vector<double> latencies;
+    unsigned int timeouts = 0;
+    for (Window w : windows) {
+        const auto start = Clock::now();
+        XUnmapWindow(display, w);
+        XFlush(display);
+        /* Done once the WM has reparented it back to the root. */
+        if (WaitForEvent(display, [w, root](const XEvent& e) {
+                return e.type == ReparentNotify && e.xreparent.window == w && e.xreparent.parent == root; })) {
+            latencies.push_back(MicrosecondsSince(start));
+        } else {
+            ++timeouts;
+        }
+    }
+    return "{" + scenario.Finish() + ", \"unframe_us\": " + Percentiles(latencies) + ", \"timeouts\": " + to_string(timeouts) + "}";
+}
+
+static string MapBurst(Display* display, const vector<Window>& windows, const string& socket_path) {
+    Scenario scenario(socket_path);
+    for (Window w : windows) {
+        XMapWindow(display, w);
+    }
+    XFlush(display);
+    size_t mapped = 0;
+    WaitForEvent(display, [&mapped, &windows](const XEvent& e) { return e.type == MapNotify && ++mapped == windows.size(); });
+    return "{" + scenario.Finish() + ", \"mapped\": " + to_string(mapped) + "}";
+}
+
+/* Holds ALT and button 1 on the topmost window and moves the pointer in
+ * small steps as fast as XTEST takes them. */
+static string Drag(Display* display, Window w, int steps, const string& socket_path) {
+    const Window frame = FrameOf(display, w);
+    Window root;
+    int x, y;
+    unsigned int width, height, border, depth;
+    if (frame == None || !XGetGeometry(display, frame, &root, &x, &y, &width, &height, &border, &depth)) {
+        return "{\"skipped\": \"no frame\"}";
+    }
+    const KeyCode alt = XKeysymToKeycode(display, XK_Alt_L);
+    XTestFakeMotionEvent(display, -1, x + 10, y + 10, 0);
+    XSync(display, false);
+    Scenario scenario(socket_path);
+    XTestFakeKeyEvent(display, alt, True, 0);
+    XTestFakeButtonEvent(display, 1, True, 0);
+    for (int i = 1; i <= steps; ++i) {
+        XTestFakeMotionEvent(display, -1, x + 10 + i, y + 10 + i / 2, 0);
+    }
+    XTestFakeButtonEvent(display, 1, False, 0);
+    XTestFakeKeyEvent(display, alt, False, 0);
+    XSync(display, false);
+    /* The release applies the last position, so wait for the frame to get there. */
+    const auto deadline = Clock::now() + chrono::milliseconds(TIMEOUT_MS);
+    int frame_x = x, frame_y = y;
+    while ((frame_x != x + steps || frame_y != y + steps / 2) && Clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        XGetGeometry(display, frame, &root, &frame_x, &frame_y, &width, &height, &border, &depth);
+    }
+    const bool arrived = frame_x == x + steps && frame_y == y + steps / 2;
+    return "{" + scenario.Finish() + ", \"motion_steps\": " + to_string(steps) + ", \"arrived\": " + (arrived ? "true" : "false") + "}";
+}
+
+/* The client asks for a new geometry many times in a row, as some toolkits
+ * do while laying out. */
+static string ConfigureStorm(Display* display, Window w, int count, const string& socket_path) {
+    Scenario scenario(socket_path);
+    int width = 0, height = 0;
+    for (int i = 0; i < count; ++i) {
+        width = 150 + i % 200;
+        height = 100 + i % 150;
+        XMoveResizeWindow(display, w, 0, 0, width, height);
+    }
+    XFlush(display);
+    const bool settled = WaitForEvent(display, [w, width, height](const XEvent& e) {
+        return e.type == ConfigureNotify && e.xconfigure.window == w && e.xconfigure.width == width && e.xconfigure.height == height; });
+    return "{" + scenario.Finish() + ", \"requests_sent\": " + to_string(count) + ", \"settled\": " + (settled ? "true" : "false") + "}";
+}
+
+/* ALT held, TAB pressed once per client; every step moves the focus. */
+static string AltTab(Display* display, size_t clients, const string& socket_path) {
+    const KeyCode alt = XKeysymToKeycode(display, XK_Alt_L);
+    const KeyCode tab = XKeysymToKeycode(display, XK_Tab);
+    Scenario scenario(socket_path);
+    XTestFakeKeyEvent(display, alt, True, 0);
+    for (size_t i = 0; i < clients; ++i) {
+        XTestFakeKeyEvent(display, tab, True, 0);
+        XTestFakeKeyEvent(display, tab, False, 0);
+    }
+    XTestFakeKeyEvent(display, alt, False, 0);
+    XFlush(display);
+    size_t focus_changes = 0;
+    WaitForEvent(display, [&focus_changes, clients](const XEvent& e) {
+        return e.type == FocusIn && e.xfocus.mode != NotifyGrab && e.xfocus.mode != NotifyUngrab &&
+            e.xfocus.detail != NotifyPointer && ++focus_changes >= clients; });
+    return "{" + scenario.Finish() + ", \"steps\": " + to_string(clients) + ", \"focus_changes\": " + to_string(focus_changes) + "}";
+}
+
+int main(int argc, char** argv) {
+    size_t count = 200;
+    string socket_path = DefaultControlSocketPath(nullptr);
+    string label;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count = max(2, atoi(argv[i + 1]));
+        } else if (strcmp(argv[i], "-s") == 0) {
+            socket_path = argv[i + 1];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            label = argv[i + 1];
+        }
+    }
+    Display* display = XOpenDisplay(nullptr);
+    if (display == nullptr) {
+        cerr << "Failed to open X Display" << endl;
+        return 1;
+    }
+    WmStats probe;
+    if (!QueryStats(socket_path, &probe)) {
+        cerr << "No LightWM control socket at " << socket_path << endl;
+        return 1;
+    }
+    int event_base, error_base, major, minor;
+    const bool xtest = XTestQueryExtension(display, &event_base, &error_base, &major, &minor);
+    const Window root = DefaultRootWindow(display);
+    vector<Window> windows;
+    for (size_t i = 0; i < count; ++i) {
+        const Window w = XCreateSimpleWindow(display, root, (i * 37) % 1500, (i * 23) % 800, 200, 150, 0, 0, 0xffffff);
+        XSelectInput(display, w, StructureNotifyMask | FocusChangeMask);
+        windows.push_back(w);
+    }
+    XSync(display, false);
+
+    ostringstream out;
+    out << "{\"label\": \"" << label << "\", \"windows\": " << count << ", \"scenarios\": {";
+    out << "\"map\": " << MapOneByOne(display, windows, socket_path);
+    out << ", \"unmap\": " << UnmapOneByOne(display, windows, socket_path);
+    out << ", \"map_burst\": " << MapBurst(display, windows, socket_path);
+    if (xtest) {
+        out << ", \"drag\": " << Drag(display, windows.back(), 600, socket_path);
+    }
+    out << ", \"configure_storm\": " << ConfigureStorm(display, windows.front(), 2000, socket_path);
+    if (xtest) {
+        out << ", \"alt_tab\": " << AltTab(display, count, socket_path);
+    }
+    out << "}, \"xtest\": " << (xtest ? "true" : "false") << "}";
+    cout << out.str() << endl;
+    XCloseDisplay(display);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include "bindings.hpp"
+#include "xconnection.hpp"
+#include <cstring>
+using namespace std;
+
+KeyBindings::KeyBindings() {
+    memset(table_, 0, sizeof(table_));
+}
+
+void KeyBindings::Rebuild(XConnection& connection) {
+    memset(table_, 0, sizeof(table_));
+    grabs_.clear();
+    for (const KeyBinding& binding : DEFAULT_KEY_BINDINGS) {
+        const KeyCode keycode = connection.KeysymToKeycode(binding.keysym);
+        if (keycode == 0) {
+            continue;
+        }
+        table_[keycode][ModifierIndex(binding.modifiers)] = binding.action;
+        grabs_.emplace_back(keycode, binding.modifiers);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef BINDINGS_HPP
+#define BINDINGS_HPP
+#include <cstdint>
+#include <utility>
+#include <vector>
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+}
+
+class XConnection;
+
+enum class Action : uint8_t {
+	NoAction = 0,
+	CloseWindow,
+	LaunchTerminal,
+	FocusNext,
+	FocusPrevious,
+};
+
+struct KeyBinding {
+	KeySym keysym;
+	unsigned int modifiers;
+	Action action;
+};
+
+// The default hotkeys. Checked at compile time below, so adding an entry
+// that collides with an existing one fails the build.
+constexpr KeyBinding DEFAULT_KEY_BINDINGS[] = {
+	{XK_Q, Mod1Mask, Action::CloseWindow},
+	{XK_Return, Mod1Mask, Action::LaunchTerminal},
+	{XK_Tab, Mod1Mask, Action::FocusNext},
+	{XK_Tab, Mod1Mask | ShiftMask, Action::FocusPrevious},
+};
+
+// Modifiers that select a binding. Lock and NumLock are ignored on lookup.
+constexpr unsigned int BINDING_MODIFIER_MASK = ShiftMask | ControlMask | Mod1Mask | Mod4Mask;
+
+// Packs the binding-relevant modifier bits of an event state into 0..15.
+constexpr unsigned int ModifierIndex(unsigned int state) {
+	return ((state & ShiftMask) ? 1 : 0) |
+	       ((state & ControlMask) ? 2 : 0) |
+	       ((state & Mod1Mask) ? 4 : 0) |
+	       ((state & Mod4Mask) ? 8 : 0);
+}
+
+template <size_t N>
+constexpr bool BindingsAreValid(const KeyBinding (&bindings)[N]) {
+	for (size_t i = 0; i < N; ++i) {
+		if (bindings[i].action == Action::NoAction || (bindings[i].modifiers & ~BINDING_MODIFIER_MASK)) {
+			return false;
+		}
+		for (size_t j = i + 1; j < N; ++j) {
+			if (bindings[i].keysym == bindings[j].keysym && bindings[i].modifiers == bindings[j].modifiers) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+static_assert(BindingsAreValid(DEFAULT_KEY_BINDINGS), "DEFAULT_KEY_BINDINGS has a duplicate, empty or unsupported binding");
+
+// Flat keycode x modifier table, so a key event dispatches with one lookup.
+// Keysyms are resolved to keycodes only in Rebuild, which the WM calls at
+// startup and on MappingNotify.
+class KeyBindings {
+	public:
+		KeyBindings();
+		void Rebuild(XConnection& connection);
+		Action Lookup(unsigned int keycode, unsigned int state) const {
+			return keycode < 256 ? table_[keycode][ModifierIndex(state)] : Action::NoAction;
+		}
+		// The (keycode, modifiers) pairs that need a passive grab.
+		const std::vector<std::pair<KeyCode, unsigned int>>& grabs() const { return grabs_; }
+
+	private:
+		Action table_[256][16];
+		std::vector<std::pair<KeyCode, unsigned int>> grabs_;
+};
+#endif
@@ -0,0 +1,97 @@
+#include "clientstore.hpp"
+#include <utility>
+using namespace std;
+
+static const size_t INITIAL_INDEX_CAPACITY = 16;
+
+WindowIndex::WindowIndex() :
+    entries_(INITIAL_INDEX_CAPACITY, Entry{None, 0}),
+    mask_(INITIAL_INDEX_CAPACITY - 1),
+    shift_(64 - 4),
+    size_(0) {
+}
+
+void WindowIndex::Set(Window key, uint32_t value) {
+    if ((size_ + 1) * 2 > entries_.size()) {
+        Grow();
+    }
+    size_t i = Home(key);
+    while (entries_[i].key != None && entries_[i].key != key) {
+        i = (i + 1) & mask_;
+    }
+    if (entries_[i].key == None) {
+        ++size_;
+    }
+    entries_[i].key = key;
+    entries_[i].value = value;
+}
+
+void WindowIndex::Erase(Window key) {
+    size_t i = Home(key);
+    while (entries_[i].key != key) {
+        if (entries_[i].key == None) {
+            return;
+        }
+        i = (i + 1) & mask_;
+    }
+    /* Backward shift: pull later entries of the probe run into the hole
+     * unless that would move them in front of their home slot. */
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask_;
+        if (entries_[j].key == None) {
+            break;
+        }
+        const size_t home = Home(entries_[j].key);
+        const bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!between) {
+            entries_[i] = entries_[j];
+            i = j;
+        }
+    }
+    entries_[i].key = None;
+    --size_;
+}
+
+void WindowIndex::Grow() {
+    vector<Entry> old(entries_.size() * 2, Entry{None, 0});
+    old.swap(entries_);
+    mask_ = entries_.size() - 1;
+    --shift_;
+    size_ = 0;
+    for (const Entry& e : old) {
+        if (e.key != None) {
+            Set(e.key, e.value);
+        }
+    }
+}
+
+Client* ClientStore::Insert(Window window, Window frame) {
+    const uint32_t slot = clients_.size();
+    clients_.emplace_back();
+    Client& client = clients_.back();
+    client.window = window;
+    client.frame = frame;
+    by_client_.Set(window, slot);
+    by_frame_.Set(frame, slot);
+    focus_ring_.PushBack(clients_, slot);
+    return &client;
+}
+
+void ClientStore::Erase(Window window) {
+    const uint32_t slot = by_client_.Find(window);
+    if (slot == WindowIndex::NOT_FOUND) {
+        return;
+    }
+    focus_ring_.Remove(clients_, slot);
+    by_client_.Erase(window);
+    by_frame_.Erase(clients_[slot].frame);
+    const uint32_t last = clients_.size() - 1;
+    if (slot != last) {
+        clients_[slot] = std::move(clients_[last]);
+        focus_ring_.Relocate(clients_, last, slot);
+        by_client_.Set(clients_[slot].window, slot);
+        by_frame_.Set(clients_[slot].frame, slot);
+    }
+    clients_.pop_back();
+}
@@ -0,0 +1,120 @@
+#ifndef CLIENTSTORE_HPP
+#define CLIENTSTORE_HPP
+#include <cstdint>
+#include <vector>
+#include "eventnames.hpp"
+#include "focusring.hpp"
+#include "xbatch.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+/* What the WM knows about a frame or client window without asking the
+ * server. Kept current from CreateNotify, ConfigureNotify, MapNotify,
+ * UnmapNotify and ReparentNotify. */
+struct CachedWindow {
+	Position<int> position;
+	Size<int> size;
+	int border_width;
+	bool mapped;
+	bool override_redirect;
+};
+
+/* How an ALT+drag reaches the client. Live sends every paced step,
+ * Outline draws a rubber band and applies the result on release, and Sync
+ * waits for the client's _NET_WM_SYNC_REQUEST counter between resizes. */
+enum class ResizeMode {
+	Live,
+	Outline,
+	Sync,
+};
+
+/* Per-client record. The FocusNode base links it into the MRU focus ring. */
+struct Client : FocusNode {
+	Window window;
+	Window frame;
+	CachedWindow geometry;
+	CachedWindow frame_geometry;
+	// Refreshed from PropertyNotify, so reading them never waits on the
+	// server.
+	WindowProperties properties;
+	ResizeMode resize_mode = ResizeMode::Live;
+};
+
+// Open-addressing (linear probing) hash map from a window id to a slot
+// index. Keys live in one flat array, deletion shifts entries back instead
+// of leaving tombstones, and the load factor stays at or below 1/2.
+class WindowIndex {
+	public:
+		static const uint32_t NOT_FOUND = UINT32_MAX;
+		WindowIndex();
+		// None is never a key, so Find(None) is NOT_FOUND.
+		uint32_t Find(Window key) const {
+			for (size_t i = Home(key);; i = (i + 1) & mask_) {
+				if (entries_[i].key == None) {
+					return NOT_FOUND;
+				}
+				if (entries_[i].key == key) {
+					return entries_[i].value;
+				}
+			}
+		}
+		// Inserts key or overwrites its value.
+		void Set(Window key, uint32_t value);
+		void Erase(Window key);
+		size_t size() const { return size_; }
+
+	private:
+		struct Entry {
+			Window key;
+			uint32_t value;
+		};
+		size_t Home(Window key) const {
+			/* Fibonacci hashing spreads the sequential ids X hands out. */
+			return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift_;
+		}
+		void Grow();
+
+		std::vector<Entry> entries_;
+		size_t mask_;
+		unsigned int shift_;
+		size_t size_;
+};
+
+// All managed clients. Records sit contiguously in slot order; removing a
+// client moves the last record into its slot. Client pointers returned by
+// Find/FindByFrame/Insert are only valid until the next Insert or Erase.
+class ClientStore {
+	public:
+		Client* Find(Window window) {
+			const uint32_t slot = by_client_.Find(window);
+			return slot == WindowIndex::NOT_FOUND ? nullptr : &clients_[slot];
+		}
+		Client* FindByFrame(Window frame) {
+			const uint32_t slot = by_frame_.Find(frame);
+			return slot == WindowIndex::NOT_FOUND ? nullptr : &clients_[slot];
+		}
+		bool Contains(Window window) const { return by_client_.Find(window) != WindowIndex::NOT_FOUND; }
+		// Adds a client at the back of the focus order.
+		Client* Insert(Window window, Window frame);
+		void Erase(Window window);
+		size_t size() const { return clients_.size(); }
+		bool empty() const { return clients_.empty(); }
+		std::vector<Client>::iterator begin() { return clients_.begin(); }
+		std::vector<Client>::iterator end() { return clients_.end(); }
+
+		// Most-recently-used focus order.
+		Client* FocusFront() { return focus_ring_.size() ? &clients_[focus_ring_.front()] : nullptr; }
+		Client* FocusNext(const Client* client) { return &clients_[client->next]; }
+		Client* FocusPrev(const Client* client) { return &clients_[client->prev]; }
+		void TouchFocus(const Client* client) { focus_ring_.Touch(clients_, SlotOf(client)); }
+
+	private:
+		uint32_t SlotOf(const Client* client) const { return client - clients_.data(); }
+
+		std::vector<Client> clients_;
+		WindowIndex by_client_;
+		WindowIndex by_frame_;
+		FocusRing focus_ring_;
+};
+#endif
@@ -0,0 +1,372 @@
+#include "compositor.hpp"
+#ifdef LIGHTWM_COMPOSITOR
+#include <algorithm>
+#include <iostream>
+#include "xbatch.hpp"
+extern "C" {
+#include <X11/Xregion.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/shape.h>
+}
+using namespace std;
+
+/* Regions keep their rectangles disjoint, so this is the pixel count. */
+static long long RegionArea(Region region) {
+    long long area = 0;
+    for (long i = 0; i < region->numRects; ++i) {
+        const BOX& box = region->rects[i];
+        area += static_cast<long long>(box.x2 - box.x1) * (box.y2 - box.y1);
+    }
+    return area;
+}
+
+/* Visuals are listed in the connection setup, so this does not wait on
+ * the server. */
+static Visual* FindVisual(Display* display, VisualID id) {
+    XVisualInfo template_info;
+    template_info.visualid = id;
+    int count = 0;
+    XVisualInfo* info = XGetVisualInfo(display, VisualIDMask, &template_info, &count);
+    Visual* visual = count > 0 ? info[0].visual : nullptr;
+    XFree(info);
+    return visual;
+}
+
+Compositor::Compositor(Display* display) :
+    display_(display),
+    root_(DefaultRootWindow(display)),
+    overlay_(None),
+    width_(0),
+    height_(0),
+    damage_event_base_(0),
+    buffer_pixmap_(None),
+    buffer_(None),
+    overlay_picture_(None),
+    background_{0x2000, 0x2000, 0x2000, 0xffff},
+    damage_(XCreateRegion()),
+    passes_(0),
+    pixels_painted_(0) {
+}
+
+Compositor::~Compositor() {
+    for (Item& item : stack_) {
+        if (item.mapped) {
+            Unmap(item);
+        }
+        if (item.damage != None) {
+            XDamageDestroy(display_, item.damage);
+        }
+    }
+    if (overlay_ != None) {
+        XRenderFreePicture(display_, buffer_);
+        XFreePixmap(display_, buffer_pixmap_);
+        XRenderFreePicture(display_, overlay_picture_);
+        XCompositeReleaseOverlayWindow(display_, root_);
+        XCompositeUnredirectSubwindows(display_, root_, CompositeRedirectManual);
+    }
+    XDestroyRegion(damage_);
+}
+
+bool Compositor::Start(const AtomRegistry& atoms) {
+    int event_base, error_base;
+    int major = 0, minor = 3;
+    if (!XCompositeQueryExtension(display_, &event_base, &error_base) || !XCompositeQueryVersion(display_, &major, &minor) ||
+        (major == 0 && minor < 3)) {
+        cerr << "Compositor: Composite 0.3 is not available" << endl;
+        return false;
+    }
+    if (!XDamageQueryExtension(display_, &damage_event_base_, &error_base)) {
+        cerr << "Compositor: Damage is not available" << endl;
+        return false;
+    }
+    if (!XFixesQueryExtension(display_, &event_base, &error_base) || !XRenderQueryExtension(display_, &event_base, &error_base)) {
+        cerr << "Compositor: XFixes or Render is not available" << endl;
+        return false;
+    }
+    const int screen = DefaultScreen(display_);
+    width_ = DisplayWidth(display_, screen);
+    height_ = DisplayHeight(display_, screen);
+    XRenderPictFormat* format = XRenderFindVisualFormat(display_, DefaultVisual(display_, screen));
+
+    XGrabServer(display_);
+    XCompositeRedirectSubwindows(display_, root_, CompositeRedirectManual);
+    overlay_ = XCompositeGetOverlayWindow(display_, root_);
+    /* Input goes through the overlay to the windows it shows. */
+    XserverRegion empty = XFixesCreateRegion(display_, nullptr, 0);
+    XFixesSetWindowShapeRegion(display_, overlay_, ShapeInput, 0, 0, empty);
+    XFixesDestroyRegion(display_, empty);
+    overlay_picture_ = XRenderCreatePicture(display_, overlay_, format, 0, nullptr);
+    buffer_pixmap_ = XCreatePixmap(display_, root_, width_, height_, DefaultDepth(display_, screen));
+    buffer_ = XRenderCreatePicture(display_, buffer_pixmap_, format, 0, nullptr);
+
+    vector<Window> children;
+    QueryChildren(display_, root_, &children);
+    children.erase(remove(children.begin(), children.end(), overlay_), children.end());
+    for (const WindowInfo& info : FetchWindowInfo(display_, children, atoms)) {
+        if (!info.valid) {
+            continue;
+        }
+        Item& item = Add(info.window, info.position.x, info.position.y, info.size.width, info.size.height, info.border_width);
+        item.visual = info.visual != 0 ? FindVisual(display_, info.visual) : nullptr;
+        if (info.mapped) {
+            Map(item);
+        }
+    }
+    XUngrabServer(display_);
+    AddDamage(0, 0, width_, height_);
+    return true;
+}
+
+bool Compositor::HandleEvent(const XEvent& event) {
+    switch (event.type) {
+        case CreateNotify: {
+            const XCreateWindowEvent& e = event.xcreatewindow;
+            if (e.parent == root_ && e.window != overlay_ && Find(e.window) == nullptr) {
+                Add(e.window, e.x, e.y, e.width, e.height, e.border_width);
+            }
+            return false;
+        }
+        case DestroyNotify:
+            if (event.xdestroywindow.event == root_) {
+                Remove(event.xdestroywindow.window, true);
+            }
+            return false;
+        case MapNotify:
+            if (event.xmap.event == root_) {
+                if (Item* item = Find(event.xmap.window)) {
+                    Map(*item);
+                }
+            }
+            return false;
+        case UnmapNotify:
+            if (event.xunmap.event == root_) {
+                if (Item* item = Find(event.xunmap.window)) {
+                    Unmap(*item);
+                }
+            }
+            return false;
+        case ReparentNotify: {
+            const XReparentEvent& e = event.xreparent;
+            if (e.event != root_) {
+                return false;
+            }
+            if (e.parent != root_) {
+                Remove(e.window, false);
+            } else if (Find(e.window) == nullptr) {
+                /* Geometry follows in a ConfigureNotify if it matters. */
+                Add(e.window, e.x, e.y, 1, 1, 0);
+            }
+            return false;
+        }
+        case ConfigureNotify: {
+            const XConfigureEvent& e = event.xconfigure;
+            Item* item = e.event == root_ ? Find(e.window) : nullptr;
+            if (item == nullptr) {
+                return false;
+            }
+            AddDamage(*item);
+            if (item->width != e.width || item->height != e.height || item->border_width != e.border_width) {
+                /* A resized window gets a new backing pixmap. */
+                ReleasePicture(*item);
+            }
+            item->x = e.x;
+            item->y = e.y;
+            item->width = e.width;
+            item->height = e.height;
+            item->border_width = e.border_width;
+            Restack(e.window, e.above);
+            AddDamage(*item);
+            return false;
+        }
+        case CirculateNotify: {
+            const XCirculateEvent& e = event.xcirculate;
+            Item* item = e.event == root_ ? Find(e.window) : nullptr;
+            if (item == nullptr) {
+                return false;
+            }
+            AddDamage(*item);
+            stack_.splice(e.place == PlaceOnTop ? stack_.end() : stack_.begin(), stack_, index_[e.window]);
+            return false;
+        }
+        default:
+            break;
+    }
+    if (event.type != damage_event_base_ + XDamageNotify) {
+        return false;
+    }
+    const XDamageNotifyEvent& e = reinterpret_cast<const XDamageNotifyEvent&>(event);
+    Item* item = Find(e.drawable);
+    if (item != nullptr && item->mapped) {
+        /* Damage is relative to the inside of the border. */
+        AddDamage(item->x + item->border_width + e.area.x, item->y + item->border_width + e.area.y, e.area.width, e.area.height);
+        item->damaged = true;
+    }
+    return true;
+}
+
+/* One pass over the damaged area. */
+long long Compositor::Paint() {
+    if (overlay_ == None || XEmptyRegion(damage_)) {
+        return 0;
+    }
+    Region repaint = damage_;
+    damage_ = XCreateRegion();
+    Region remaining = XCreateRegion();
+    XUnionRegion(repaint, repaint, remaining);
+    Region clip = XCreateRegion();
+    const long long pixels = RegionArea(repaint);
+
+    /* Top to bottom: what a window paints is taken out of what is left for
+     * the windows below it, so occluded parts are never drawn. */
+    for (auto i = stack_.rbegin(); i != stack_.rend() && !XEmptyRegion(remaining); ++i) {
+        Item& item = *i;
+        if (!item.mapped) {
+            continue;
+        }
+        XRectangle bounds;
+        bounds.x = item.x;
+        bounds.y = item.y;
+        bounds.width = item.width + 2 * item.border_width;
+        bounds.height = item.height + 2 * item.border_width;
+        Region window_region = XCreateRegion();
+        XUnionRectWithRegion(&bounds, window_region, window_region);
+        XIntersectRegion(window_region, remaining, clip);
+        if (!XEmptyRegion(clip) && EnsurePicture(item)) {
+            XRenderSetPictureClipRegion(display_, buffer_, clip);
+            XRenderComposite(display_, PictOpSrc, item.picture, None, buffer_, 0, 0, 0, 0,
+                             bounds.x, bounds.y, bounds.width, bounds.height);
+            XSubtractRegion(remaining, window_region, remaining);
+        }
+        XDestroyRegion(window_region);
+    }
+    if (!XEmptyRegion(remaining)) {
+        XRenderSetPictureClipRegion(display_, buffer_, remaining);
+        XRenderFillRectangle(display_, PictOpSrc, buffer_, &background_, 0, 0, width_, height_);
+    }
+    /* Only the repaired area reaches the screen, in one copy. */
+    XRenderSetPictureClipRegion(display_, overlay_picture_, repaint);
+    XRenderComposite(display_, PictOpSrc, buffer_, None, overlay_picture_, 0, 0, 0, 0, 0, 0, width_, height_);
+    for (Item& item : stack_) {
+        if (item.damaged) {
+            XDamageSubtract(display_, item.damage, None, None);
+            item.damaged = false;
+        }
+    }
+    XDestroyRegion(clip);
+    XDestroyRegion(remaining);
+    XDestroyRegion(repaint);
+
+    ++passes_;
+    pixels_painted_ += pixels;
+    return pixels;
+}
+
+Compositor::Item* Compositor::Find(Window window) {
+    const auto i = index_.find(window);
+    return i == index_.end() ? nullptr : &*i->second;
+}
+
+/* New windows start unmapped at the top of the stack. */
+Compositor::Item& Compositor::Add(Window window, int x, int y, int width, int height, int border_width) {
+    stack_.push_back(Item{window, x, y, width, height, border_width, false, false, nullptr, None, None, None});
+    index_[window] = prev(stack_.end());
+    return stack_.back();
+}
+
+void Compositor::Remove(Window window, bool destroyed) {
+    const auto i = index_.find(window);
+    if (i == index_.end()) {
+        return;
+    }
+    Item& item = *i->second;
+    if (item.mapped) {
+        Unmap(item);
+    }
+    if (item.damage != None && !destroyed) {
+        XDamageDestroy(display_, item.damage);
+    }
+    stack_.erase(i->second);
+    index_.erase(i);
+}
+
+/* Moves window to just above sibling, or to the bottom for None. */
+void Compositor::Restack(Window window, Window above) {
+    const auto i = index_.find(window);
+    if (i == index_.end()) {
+        return;
+    }
+    const auto sibling = index_.find(above);
+    stack_.splice(sibling == index_.end() ? stack_.begin() : next(sibling->second), stack_, i->second);
+}
+
+void Compositor::Map(Item& item) {
+    if (item.mapped) {
+        return;
+    }
+    item.mapped = true;
+    if (item.damage == None) {
+        item.damage = XDamageCreate(display_, item.window, XDamageReportDeltaRectangles);
+    }
+    AddDamage(item);
+}
+
+/* By the time the UnmapNotify of a destroyed window arrives the window and
+ * its damage object are gone, so the damage object is kept until Remove
+ * knows which it was. The named pixmap outlives the window and is ours to
+ * free either way. */
+void Compositor::Unmap(Item& item) {
+    if (!item.mapped) {
+        return;
+    }
+    item.mapped = false;
+    AddDamage(item);
+    ReleasePicture(item);
+    item.damaged = false;
+}
+
+void Compositor::ReleasePicture(Item& item) {
+    if (item.picture != None) {
+        XRenderFreePicture(display_, item.picture);
+        XFreePixmap(display_, item.pixmap);
+    }
+    item.picture = None;
+    item.pixmap = None;
+}
+
+/* Names the window's off-screen pixmap the first time it is painted after
+ * being mapped or resized. */
+bool Compositor::EnsurePicture(Item& item) {
+    if (item.picture != None) {
+        return true;
+    }
+    if (item.visual == nullptr) {
+        XWindowAttributes attrs;
+        if (!XGetWindowAttributes(display_, item.window, &attrs)) {
+            return false;
+        }
+        item.visual = attrs.visual;
+    }
+    XRenderPictFormat* format = XRenderFindVisualFormat(display_, item.visual);
+    if (format == nullptr) {
+        return false;
+    }
+    item.pixmap = XCompositeNameWindowPixmap(display_, item.window);
+    XRenderPictureAttributes attributes;
+    attributes.subwindow_mode = IncludeInferiors;
+    item.picture = XRenderCreatePicture(display_, item.pixmap, format, CPSubwindowMode, &attributes);
+    return true;
+}
+
+void Compositor::AddDamage(const Item& item) {
+    AddDamage(item.x, item.y, item.width + 2 * item.border_width, item.height + 2 * item.border_width);
+}
+
+void Compositor::AddDamage(int x, int y, int width, int height) {
+    XRectangle rect;
+    rect.x = max(-32768, min(32767, x));
+    rect.y = max(-32768, min(32767, y));
+    rect.width = max(0, min(65535, width));
+    rect.height = max(0, min(65535, height));
+    XUnionRectWithRegion(&rect, damage_, damage_);
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef COMPOSITOR_HPP
+#define COMPOSITOR_HPP
+// Only built with "scons compositor=1", which defines LIGHTWM_COMPOSITOR
+// and links Xcomposite, Xdamage, Xfixes and Xrender.
+#ifdef LIGHTWM_COMPOSITOR
+#include <list>
+#include <unordered_map>
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xrender.h>
+}
+
+// Software compositor for the root window's children. They are redirected
+// off screen and drawn with XRender into a back buffer, which is copied to
+// the composite overlay window in one operation so moves do not tear.
+//
+// Only damaged pixels are repainted. Damage is collected client-side as an
+// Xlib Region; a pass paints windows top to bottom, each clipped to what
+// is still damaged and not covered by a window above it, and the rest
+// with the background. Windows are treated as opaque.
+class AtomRegistry;
+
+class Compositor {
+	public:
+		explicit Compositor(Display* display);
+		~Compositor();
+		// Redirects the root's children and takes over the overlay window.
+		// Returns false if an extension is missing. The children's
+		// attributes are fetched in one batch, which wants the WM's atoms.
+		bool Start(const AtomRegistry& atoms);
+		// Tracks structure events on the root and consumes damage events.
+		// Returns true if the event was a damage event.
+		bool HandleEvent(const XEvent& event);
+		// Repaints the damaged area, if any, and returns the number of pixels
+		// touched. The requests are only queued; nothing waits for the
+		// server to carry them out.
+		long long Paint();
+
+		unsigned long passes() const { return passes_; }
+		unsigned long long pixels_painted() const { return pixels_painted_; }
+
+	private:
+		struct Item {
+			Window window;
+			int x, y, width, height, border_width;
+			bool mapped;
+			bool damaged;
+			Visual* visual;
+			Damage damage;
+			Pixmap pixmap;
+			Picture picture;
+		};
+		typedef std::list<Item>::iterator Iterator;
+		Item* Find(Window window);
+		Item& Add(Window window, int x, int y, int width, int height, int border_width);
+		// destroyed: the window is gone, and the server has freed its damage
+		// object with it.
+		void Remove(Window window, bool destroyed);
+		void Restack(Window window, Window above);
+		void Map(Item& item);
+		void Unmap(Item& item);
+		void ReleasePicture(Item& item);
+		bool EnsurePicture(Item& item);
+		void AddDamage(const Item& item);
+		void AddDamage(int x, int y, int width, int height);
+
+		Display* display_;
+		const Window root_;
+		Window overlay_;
+		int width_;
+		int height_;
+		int damage_event_base_;
+		Pixmap buffer_pixmap_;
+		Picture buffer_;
+		Picture overlay_picture_;
+		XRenderColor background_;
+		Region damage_;
+		// Bottom to top, like the server's stacking order, and by window.
+		std::list<Item> stack_;
+		std::unordered_map<Window, Iterator> index_;
+		unsigned long passes_;
+		unsigned long long pixels_painted_;
+};
+#endif
+#endif
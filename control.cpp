@@ -0,0 +1,142 @@
+#include "control.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+using namespace std;
+
+/* /tmp is shared, so the directory is only trusted if it is ours and
+ * nobody else can put a socket of their own in it. */
+bool PrepareSocketDirectory(const string& path) {
+    const string directory = FallbackControlSocketDirectory();
+    if (path.compare(0, path.rfind('/'), directory) != 0) {
+        return true;
+    }
+    if (mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST) {
+        cerr << "Failed to create " << directory << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat info;
+    if (lstat(directory.c_str(), &info) < 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() ||
+        (info.st_mode & 077) != 0) {
+        cerr << directory << " is not a private directory owned by this user" << endl;
+        return false;
+    }
+    return true;
+}
+
+ControlServer::ControlServer(EventLoop& loop, CommandHandler on_command, function<void()> on_batch_done) :
+    loop_(loop),
+    on_command_(on_command),
+    on_batch_done_(on_batch_done),
+    listen_fd_(-1) {
+}
+
+ControlServer::~ControlServer() {
+    while (!clients_.empty()) {
+        Drop(clients_.back());
+    }
+    if (listen_fd_ >= 0) {
+        loop_.Remove(listen_fd_);
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool ControlServer::Open(const string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Control socket path too long: " << path << endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    if (!PrepareSocketDirectory(path)) {
+        return false;
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        cerr << "Failed to create control socket: " << strerror(errno) << endl;
+        return false;
+    }
+    unlink(path.c_str());
+    /* Nobody can connect before listen, so the mode is set in between. */
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || chmod(path.c_str(), 0600) < 0 ||
+        listen(listen_fd_, 8) < 0) {
+        cerr << "Failed to listen on " << path << ": " << strerror(errno) << endl;
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    path_ = path;
+    loop_.Add(listen_fd_, EPOLLIN, [this](uint32_t) { Accept(); });
+    return true;
+}
+
+void ControlServer::Accept() {
+    int fd;
+    while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        clients_.push_back(fd);
+        loop_.Add(fd, EPOLLIN, [this, fd](uint32_t events) {
+            if (events & (EPOLLHUP | EPOLLERR)) {
+                Drop(fd);
+            } else {
+                Serve(fd);
+            }
+        });
+    }
+}
+
+void ControlServer::Serve(int fd) {
+    static char buffer[CONTROL_MAX_MESSAGE];
+    const ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if (length <= 0) {
+        if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            Drop(fd);
+        }
+        return;
+    }
+    istringstream request(string(buffer, length));
+    string reply;
+    string line;
+    while (getline(request, line)) {
+        istringstream words_in(line);
+        vector<string> words;
+        string word;
+        while (words_in >> word) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        string reply_line = on_command_(words);
+        if (reply.size() + reply_line.size() + 1 > CONTROL_MAX_MESSAGE) {
+            reply_line = "error reply too long";
+        }
+        reply += reply_line;
+        reply += '\n';
+    }
+    /* Only a flood of commands gets this far; the client cannot read more. */
+    if (reply.size() > CONTROL_MAX_MESSAGE) {
+        reply.resize(reply.rfind('\n', CONTROL_MAX_MESSAGE - 1) + 1);
+    }
+    on_batch_done_();
+    if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) {
+        Drop(fd);
+    }
+}
+
+void ControlServer::Drop(int fd) {
+    loop_.Remove(fd);
+    close(fd);
+    clients_.erase(remove(clients_.begin(), clients_.end(), fd), clients_.end());
+}
@@ -0,0 +1,105 @@
+#ifndef CONTROL_HPP
+#define CONTROL_HPP
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+#include "eventloop.hpp"
+extern "C" {
+#include <unistd.h>
+}
+
+/* Control socket protocol. The socket is SOCK_SEQPACKET, so message
+ * boundaries are kept: a request is one message holding one command per
+ * line, and the reply is one message holding one line per command, each
+ * starting with "ok" or "error". All commands of a request are applied
+ * before the WM flushes its output once.
+ *
+ *   list [<first>]             -> ok <client> <frame> <x> <y> <w> <h>;...
+ *                                 (most recently focused first, from the
+ *                                 <first>th on; a list too long for one
+ *                                 reply stops early and ends in ";next <n>",
+ *                                 the <first> to ask for the rest with)
+ *   stats                      -> ok events <n> requests <n> busy_us <n>
+ *                                 (X events dispatched, X requests sent and
+ *                                 time spent dispatching since startup)
+ *   roundtrips                 -> ok <handler> <request> <n> <blocked_us>;...
+ *                                 (with LIGHTWM_AUDIT_ROUND_TRIPS=1 only)
+ *   move <window> <x> <y>
+ *   resize <window> <w> <h>
+ *   raise <window>
+ *   focus <window>
+ *   close <window>
+ *   resize-mode <window> live|outline|sync
+ *   launch <command line>
+ *
+ * Windows may be given in decimal or 0x-prefixed hex. A request and its
+ * reply are at most CONTROL_MAX_MESSAGE bytes each; a command whose reply
+ * line would not fit gets "error reply too long", and the lines of a
+ * request too big to answer stop at the limit.
+ *
+ * Only the user running the WM can connect: the socket is created mode
+ * 0600 in $XDG_RUNTIME_DIR or, without one, in a /tmp/lightwm-<uid>
+ * directory of mode 0700. */
+#define CONTROL_MAX_MESSAGE 65536
+
+// Where the socket goes without $XDG_RUNTIME_DIR. ControlServer::Open
+// creates it if needed.
+inline std::string FallbackControlSocketDirectory() {
+	return "/tmp/lightwm-" + std::to_string(getuid());
+}
+
+inline std::string ControlSocketDirectory() {
+	const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir != nullptr && runtime_dir[0] != '\0') {
+		return runtime_dir;
+	}
+	return FallbackControlSocketDirectory();
+}
+
+// For a socket path in FallbackControlSocketDirectory(): creates the
+// directory with mode 0700 if needed and returns false if someone else
+// owns it or can write to it. True for any other path.
+bool PrepareSocketDirectory(const std::string& path);
+
+// LIGHTWM_SOCKET, or a per-display path in ControlSocketDirectory().
+inline std::string DefaultControlSocketPath(const char* display_name) {
+	const char* path = getenv("LIGHTWM_SOCKET");
+	if (path != nullptr) {
+		return path;
+	}
+	std::string display = display_name ? display_name : "";
+	if (display.empty() && getenv("DISPLAY") != nullptr) {
+		display = getenv("DISPLAY");
+	}
+	for (char& c : display) {
+		if (c == ':' || c == '/') {
+			c = '_';
+		}
+	}
+	return ControlSocketDirectory() + "/lightwm" + display + ".sock";
+}
+
+class ControlServer {
+	public:
+		// Runs one command (already split into words) and returns its reply line.
+		typedef std::function<std::string(const std::vector<std::string>& words)> CommandHandler;
+
+		ControlServer(EventLoop& loop, CommandHandler on_command, std::function<void()> on_batch_done);
+		~ControlServer();
+		// Listens on path with mode 0600, after PrepareSocketDirectory.
+		bool Open(const std::string& path);
+
+	private:
+		void Accept();
+		void Serve(int fd);
+		void Drop(int fd);
+
+		EventLoop& loop_;
+		CommandHandler on_command_;
+		std::function<void()> on_batch_done_;
+		int listen_fd_;
+		std::string path_;
+		std::vector<int> clients_;
+};
+#endif
@@ -0,0 +1,105 @@
+#include "eventloop.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+}
+using namespace std;
+
+EventLoop::EventLoop() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), running_(false) {
+    if (epoll_fd_ < 0) {
+        cerr << "epoll_create1 failed: " << strerror(errno) << endl;
+    }
+}
+
+EventLoop::~EventLoop() {
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+bool EventLoop::Add(int fd, uint32_t events, Handler handler) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        cerr << "epoll_ctl failed for fd " << fd << ": " << strerror(errno) << endl;
+        return false;
+    }
+    handlers_[fd] = make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+void EventLoop::Remove(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    handlers_.erase(fd);
+}
+
+int EventLoop::AddTimer(Handler handler) {
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        cerr << "timerfd_create failed: " << strerror(errno) << endl;
+        return -1;
+    }
+    Add(fd, EPOLLIN, [fd, handler](uint32_t events) {
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            handler(events);
+        }
+    });
+    return fd;
+}
+
+void EventLoop::ArmTimer(int timer_fd, chrono::nanoseconds delay) {
+    /* A zero it_value would disarm the timer, so fire after 1ns instead. */
+    const long long ns = max<long long>(1, delay.count());
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+void EventLoop::DisarmTimer(int timer_fd) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+void EventLoop::RemoveTimer(int timer_fd) {
+    Remove(timer_fd);
+    close(timer_fd);
+}
+
+void EventLoop::Run(const function<void()>& before_sleep) {
+    const int MAX_EVENTS = 16;
+    struct epoll_event events[MAX_EVENTS];
+    running_ = true;
+    while (running_) {
+        before_sleep();
+        if (!running_) {
+            break;
+        }
+        const int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "epoll_wait failed: " << strerror(errno) << endl;
+            break;
+        }
+        for (int i = 0; i < n && running_; ++i) {
+            /* A handler may have removed this fd already, or remove it
+             * while running, so hold a reference for the call. */
+            const auto handler = handlers_.find(events[i].data.fd);
+            if (handler != handlers_.end()) {
+                const shared_ptr<Handler> h = handler->second;
+                (*h)(events[i].events);
+            }
+        }
+    }
+}
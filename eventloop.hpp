@@ -0,0 +1,40 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// epoll-based main loop. Every source (the X connection, timers, signal
+// and socket fds) is registered with a handler that runs when the fd is
+// ready. before_sleep runs ahead of every epoll_wait, which is where the
+// WM drains events Xlib has already buffered.
+class EventLoop {
+	public:
+		typedef std::function<void(uint32_t events)> Handler;
+
+		EventLoop();
+		~EventLoop();
+
+		bool Add(int fd, uint32_t events, Handler handler);
+		void Remove(int fd);
+
+		// Creates a timerfd driven source; returns its fd or -1.
+		int AddTimer(Handler handler);
+		// Fires once after delay (delay <= 0 fires as soon as possible).
+		void ArmTimer(int timer_fd, std::chrono::nanoseconds delay);
+		void DisarmTimer(int timer_fd);
+		// Removes a timer added with AddTimer and closes it.
+		void RemoveTimer(int timer_fd);
+
+		// Runs until Stop() is called from a handler.
+		void Run(const std::function<void()>& before_sleep);
+		void Stop() { running_ = false; }
+
+	private:
+		int epoll_fd_;
+		bool running_;
+		std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+};
+#endif
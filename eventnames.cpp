@@ -4,46 +4,54 @@
 #include <vector>
 using namespace std;
 
+static const char* const X_EVENT_TYPE_NAMES[] = {
+    "",
+    "",
+    "KeyPress",
+    "KeyRelease",
+    "ButtonPress",
+    "ButtonRelease",
+    "MotionNotify",
+    "EnterNotify",
+    "LeaveNotify",
+    "FocusIn",
+    "FocusOut",
+    "KeymapNotify",
+    "Expose",
+    "GraphicsExpose",
+    "NoExpose",
+    "VisibilityNotify",
+    "CreateNotify",
+    "DestroyNotify",
+    "UnmapNotify",
+    "MapNotify",
+    "MapRequest",
+    "ReparentNotify",
+    "ConfigureNotify",
+    "ConfigureRequest",
+    "GravityNotify",
+    "ResizeRequest",
+    "CirculateNotify",
+    "CirculateRequest",
+    "PropertyNotify",
+    "SelectionClear",
+    "SelectionRequest",
+    "SelectionNotify",
+    "ColormapNotify",
+    "ClientMessage",
+    "MappingNotify",
+};
+
+string EventTypeName(int type) {
+  const int count = sizeof(X_EVENT_TYPE_NAMES) / sizeof(X_EVENT_TYPE_NAMES[0]);
+  if (type >= KeyPress && type < count) {
+    return X_EVENT_TYPE_NAMES[type];
+  }
+  return "Event" + ToString(type);
+}
+
 /* Print event information */
 string ToString(const XEvent& e) {
-  static const char* const X_EVENT_TYPE_NAMES[] = {
-      "",
-      "",
-      "KeyPress",
-      "KeyRelease",
-      "ButtonPress",
-      "ButtonRelease",
-      "MotionNotify",
-      "EnterNotify",
-      "LeaveNotify",
-      "FocusIn",
-      "FocusOut",
-      "KeymapNotify",
-      "Expose",
-      "GraphicsExpose",
-      "NoExpose",
-      "VisibilityNotify",
-      "CreateNotify",
-      "DestroyNotify",
-      "UnmapNotify",
-      "MapNotify",
-      "MapRequest",
-      "ReparentNotify",
-      "ConfigureNotify",
-      "ConfigureRequest",
-      "GravityNotify",
-      "ResizeRequest",
-      "CirculateNotify",
-      "CirculateRequest",
-      "PropertyNotify",
-      "SelectionClear",
-      "SelectionRequest",
-      "SelectionNotify",
-      "ColormapNotify",
-      "ClientMessage",
-      "MappingNotify",
-  };
-
   vector<pair<string, string>> properties;
   switch (e.type) {
     case CreateNotify:
@@ -120,7 +128,7 @@ string ToString(const XEvent& e) {
         return pair.first + ": " + pair.second;});
   string result;
   string seperator = " ## ";
-  result = X_EVENT_TYPE_NAMES[e.type] + seperator + properties_string + seperator;
+  result = EventTypeName(e.type) + seperator + properties_string + seperator;
   return result;
 }
 
@@ -274,5 +282,10 @@ string XRequestCodeToString(unsigned char request_code) {
       "GetModifierMapping",
       "NoOperation",
   };
+  // Extension requests (128 and up) have no core name; their major opcode
+  // is assigned by the server.
+  if (request_code >= sizeof(X_REQUEST_CODE_NAMES) / sizeof(X_REQUEST_CODE_NAMES[0])) {
+    return "Extension request " + to_string(request_code);
+  }
   return X_REQUEST_CODE_NAMES[request_code];
 }
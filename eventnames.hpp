@@ -98,6 +98,9 @@ std::string ToString(const T& x);
 // Returns a string describing an X event for debugging purposes.
 extern std::string ToString(const XEvent& e);
 
+// Returns the name of a core event type, or "Event<type>" for extension events.
+extern std::string EventTypeName(int type);
+
 // Returns a string describing an X window configuration value mask.
 extern std::string XConfigureWindowValueMaskToString(unsigned long value_mask);
 
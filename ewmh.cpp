@@ -0,0 +1,83 @@
+#include "ewmh.hpp"
+#include <algorithm>
+extern "C" {
+#include <X11/Xatom.h>
+}
+using namespace std;
+
+Ewmh::Ewmh() :
+    connection_(nullptr),
+    root_(None),
+    net_client_list_(None),
+    net_active_window_(None),
+    check_window_(None),
+    active_(None) {
+}
+
+void Ewmh::Start(XConnection* connection, const AtomRegistry& atoms, const string& wm_name) {
+    connection_ = connection;
+    root_ = connection->root();
+    net_client_list_ = atoms[AtomId::NET_CLIENT_LIST];
+    net_active_window_ = atoms[AtomId::NET_ACTIVE_WINDOW];
+    const long supported[] = {
+        static_cast<long>(atoms[AtomId::NET_SUPPORTED]),
+        static_cast<long>(atoms[AtomId::NET_SUPPORTING_WM_CHECK]),
+        static_cast<long>(atoms[AtomId::NET_CLIENT_LIST]),
+        static_cast<long>(atoms[AtomId::NET_ACTIVE_WINDOW]),
+        static_cast<long>(atoms[AtomId::NET_WM_NAME]),
+        static_cast<long>(atoms[AtomId::NET_WM_SYNC_REQUEST]),
+        static_cast<long>(atoms[AtomId::NET_WM_SYNC_REQUEST_COUNTER]),
+    };
+    connection_->ChangeProperty(root_, atoms[AtomId::NET_SUPPORTED], XA_ATOM, 32, PropModeReplace,
+                                supported, sizeof(supported) / sizeof(supported[0]));
+    /* A never mapped child of the root names the WM; pagers check that it
+     * points at itself to tell a running WM from a stale property. */
+    check_window_ = connection_->CreateWindow(root_, -1, -1, 1, 1, 0, 0, 0);
+    const long check = check_window_;
+    for (Window w : {root_, check_window_}) {
+        connection_->ChangeProperty(w, atoms[AtomId::NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32, PropModeReplace, &check, 1);
+    }
+    connection_->ChangeProperty(check_window_, atoms[AtomId::NET_WM_NAME], atoms[AtomId::UTF8_STRING], 8, PropModeReplace,
+                                wm_name.data(), wm_name.size());
+    ReplaceClientList();
+    const long none = None;
+    connection_->ChangeProperty(root_, net_active_window_, XA_WINDOW, 32, PropModeReplace, &none, 1);
+}
+
+void Ewmh::AddClient(Window w) {
+    clients_.push_back(w);
+    if (connection_ != nullptr) {
+        const long client = w;
+        connection_->ChangeProperty(root_, net_client_list_, XA_WINDOW, 32, PropModeAppend, &client, 1);
+    }
+}
+
+void Ewmh::RemoveClient(Window w) {
+    const auto i = find(clients_.begin(), clients_.end(), w);
+    if (i == clients_.end()) {
+        return;
+    }
+    clients_.erase(i);
+    if (connection_ != nullptr) {
+        ReplaceClientList();
+    }
+    if (active_ == w) {
+        SetActiveWindow(None);
+    }
+}
+
+void Ewmh::SetActiveWindow(Window w) {
+    if (w == active_) {
+        return;
+    }
+    active_ = w;
+    if (connection_ != nullptr) {
+        const long active = w;
+        connection_->ChangeProperty(root_, net_active_window_, XA_WINDOW, 32, PropModeReplace, &active, 1);
+    }
+}
+
+void Ewmh::ReplaceClientList() {
+    const vector<long> clients(clients_.begin(), clients_.end());
+    connection_->ChangeProperty(root_, net_client_list_, XA_WINDOW, 32, PropModeReplace, clients.data(), clients.size());
+}
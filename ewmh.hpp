@@ -0,0 +1,37 @@
+#ifndef EWMH_HPP
+#define EWMH_HPP
+#include <string>
+#include <vector>
+#include "atoms.hpp"
+#include "xconnection.hpp"
+
+// Keeps the EWMH root window properties that panels and pagers watch:
+// _NET_SUPPORTED, _NET_SUPPORTING_WM_CHECK, _NET_CLIENT_LIST (in mapping
+// order) and _NET_ACTIVE_WINDOW. Only requests are sent, never a query.
+// A new client is appended to _NET_CLIENT_LIST with PropModeAppend, so a
+// map costs one small request however many clients there are; only a
+// removal rewrites the list.
+class Ewmh {
+	public:
+		Ewmh();
+		// Creates the check window and publishes the properties, with no
+		// clients and no active window. Nothing is sent before this.
+		void Start(XConnection* connection, const AtomRegistry& atoms, const std::string& wm_name);
+		void AddClient(Window w);
+		void RemoveClient(Window w);
+		// None when no client has the focus. Unchanged values are not sent.
+		void SetActiveWindow(Window w);
+		const std::vector<Window>& clients() const { return clients_; }
+
+	private:
+		void ReplaceClientList();
+
+		XConnection* connection_;
+		Window root_;
+		Atom net_client_list_;
+		Atom net_active_window_;
+		Window check_window_;
+		std::vector<Window> clients_;
+		Window active_;
+};
+#endif
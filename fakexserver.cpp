@@ -0,0 +1,641 @@
+#include "fakexserver.hpp"
+#include <algorithm>
+#include <cstring>
+extern "C" {
+#include <X11/Xatom.h>
+}
+using namespace std;
+
+const Window FakeXServer::ROOT;
+
+FakeXServer::FakeXServer(int width, int height) :
+    screen_(width, height),
+    next_wm_window_(0x200001),
+    next_client_window_(0x400001),
+    focus_(PointerRoot),
+    requests_(0),
+    errors_(0),
+    sent_events_(0) {
+    FakeWindow& root = windows_[ROOT];
+    root.parent = None;
+    root.x = root.y = 0;
+    root.width = width;
+    root.height = height;
+    root.border_width = 0;
+    root.mapped = true;
+    root.override_redirect = false;
+    root.event_mask = NoEventMask;
+}
+
+FakeXServer::FakeWindow* FakeXServer::Find(Window w) {
+    const auto i = windows_.find(w);
+    return i != windows_.end() ? &i->second : nullptr;
+}
+
+FakeXServer::FakeWindow* FakeXServer::Target(Window w) {
+    FakeWindow* window = Find(w);
+    if (window == nullptr) {
+        ++errors_;
+    }
+    return window;
+}
+
+const FakeXServer::FakeWindow* FakeXServer::Find(Window w) const {
+    const auto i = windows_.find(w);
+    return i != windows_.end() ? &i->second : nullptr;
+}
+
+XEvent FakeXServer::NewEvent(int type) {
+    XEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.xany.serial = requests_;
+    return event;
+}
+
+void FakeXServer::Deliver(XEvent event, Window to) {
+    event.xany.window = to;
+    events_.push_back(event);
+}
+
+void FakeXServer::Notify(const XEvent& event, const FakeWindow& window, Window w) {
+    if (window.event_mask & StructureNotifyMask) {
+        Deliver(event, w);
+    }
+    const FakeWindow* parent = Find(window.parent);
+    if (parent != nullptr && (parent->event_mask & SubstructureNotifyMask)) {
+        Deliver(event, window.parent);
+    }
+}
+
+/* The WM is the only client that selects input, so a parent it redirects
+ * turns other clients' requests into events for it. */
+bool FakeXServer::Redirected(const FakeWindow& window) const {
+    const FakeWindow* parent = Find(window.parent);
+    return !window.override_redirect && parent != nullptr && (parent->event_mask & SubstructureRedirectMask);
+}
+
+void FakeXServer::NextEvent(XEvent* event) {
+    /* A real server would block; there is nothing to wait for here. */
+    if (events_.empty()) {
+        *event = NewEvent(0);
+        return;
+    }
+    *event = events_.front();
+    events_.pop_front();
+}
+
+bool FakeXServer::CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) {
+    for (auto i = events_.begin(); i != events_.end(); ++i) {
+        if (predicate(nullptr, &*i, arg)) {
+            *event = *i;
+            events_.erase(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Window FakeXServer::NewWindow(Window parent, Window id, int x, int y, unsigned int width, unsigned int height,
+                              unsigned int border_width, bool override_redirect) {
+    FakeWindow* p = Target(parent);
+    if (p == nullptr) {
+        return None;
+    }
+    p->children.push_back(id);
+    FakeWindow& window = windows_[id];
+    window.parent = parent;
+    window.x = x;
+    window.y = y;
+    window.width = width;
+    window.height = height;
+    window.border_width = border_width;
+    window.mapped = false;
+    window.override_redirect = override_redirect;
+    window.event_mask = NoEventMask;
+    XEvent event = NewEvent(CreateNotify);
+    event.xcreatewindow.window = id;
+    event.xcreatewindow.x = x;
+    event.xcreatewindow.y = y;
+    event.xcreatewindow.width = width;
+    event.xcreatewindow.height = height;
+    event.xcreatewindow.border_width = border_width;
+    event.xcreatewindow.override_redirect = override_redirect;
+    Notify(event, window, id);
+    return id;
+}
+
+Window FakeXServer::CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+                                 unsigned int border_width, unsigned long border, unsigned long background) {
+    ++requests_;
+    return NewWindow(parent, next_wm_window_++, x, y, width, height, border_width, false);
+}
+
+void FakeXServer::DoMap(Window w, FakeWindow& window) {
+    if (window.mapped) {
+        return;
+    }
+    window.mapped = true;
+    XEvent event = NewEvent(MapNotify);
+    event.xmap.window = w;
+    event.xmap.override_redirect = window.override_redirect;
+    Notify(event, window, w);
+}
+
+void FakeXServer::DoUnmap(Window w, FakeWindow& window) {
+    if (!window.mapped) {
+        return;
+    }
+    window.mapped = false;
+    XEvent event = NewEvent(UnmapNotify);
+    event.xunmap.window = w;
+    Notify(event, window, w);
+}
+
+void FakeXServer::DoConfigure(Window w, FakeWindow& window, unsigned int value_mask, const XWindowChanges& changes) {
+    if (value_mask & CWX) {
+        window.x = changes.x;
+    }
+    if (value_mask & CWY) {
+        window.y = changes.y;
+    }
+    if (value_mask & CWWidth) {
+        window.width = max(1, changes.width);
+    }
+    if (value_mask & CWHeight) {
+        window.height = max(1, changes.height);
+    }
+    if (value_mask & CWBorderWidth) {
+        window.border_width = changes.border_width;
+    }
+    Window above = None;
+    if (FakeWindow* parent = Find(window.parent)) {
+        vector<Window>& siblings = parent->children;
+        if ((value_mask & CWStackMode) && (changes.stack_mode == Above || changes.stack_mode == Below)) {
+            siblings.erase(find(siblings.begin(), siblings.end(), w));
+            if (changes.stack_mode == Above) {
+                siblings.push_back(w);
+            } else {
+                siblings.insert(siblings.begin(), w);
+            }
+        }
+        const auto i = find(siblings.begin(), siblings.end(), w);
+        above = i == siblings.begin() ? None : *(i - 1);
+    }
+    XEvent event = NewEvent(ConfigureNotify);
+    event.xconfigure.window = w;
+    event.xconfigure.x = window.x;
+    event.xconfigure.y = window.y;
+    event.xconfigure.width = window.width;
+    event.xconfigure.height = window.height;
+    event.xconfigure.border_width = window.border_width;
+    event.xconfigure.above = above;
+    event.xconfigure.override_redirect = window.override_redirect;
+    Notify(event, window, w);
+}
+
+/* Children first, as the server reports them. */
+void FakeXServer::DoDestroy(Window w) {
+    FakeWindow* window = Find(w);
+    if (window == nullptr) {
+        return;
+    }
+    DoUnmap(w, *window);
+    const vector<Window> children = window->children;
+    for (Window child : children) {
+        DoDestroy(child);
+    }
+    window = Find(w);
+    XEvent event = NewEvent(DestroyNotify);
+    event.xdestroywindow.window = w;
+    Notify(event, *window, w);
+    if (FakeWindow* parent = Find(window->parent)) {
+        parent->children.erase(find(parent->children.begin(), parent->children.end(), w));
+    }
+    if (focus_ == w) {
+        focus_ = PointerRoot;
+    }
+    windows_.erase(w);
+}
+
+void FakeXServer::DestroyWindow(Window w) {
+    ++requests_;
+    if (w != ROOT && Target(w) != nullptr) {
+        DoDestroy(w);
+    }
+}
+
+void FakeXServer::MapWindow(Window w) {
+    ++requests_;
+    if (FakeWindow* window = Target(w)) {
+        DoMap(w, *window);
+    }
+}
+
+void FakeXServer::UnmapWindow(Window w) {
+    ++requests_;
+    if (FakeWindow* window = Target(w)) {
+        DoUnmap(w, *window);
+    }
+}
+
+/* A mapped window is unmapped, moved and mapped again. */
+void FakeXServer::ReparentWindow(Window w, Window parent, int x, int y) {
+    ++requests_;
+    FakeWindow* window = Target(w);
+    FakeWindow* new_parent = Target(parent);
+    if (window == nullptr || new_parent == nullptr) {
+        return;
+    }
+    const bool was_mapped = window->mapped;
+    DoUnmap(w, *window);
+    const Window old_parent = window->parent;
+    if (FakeWindow* p = Find(old_parent)) {
+        p->children.erase(find(p->children.begin(), p->children.end(), w));
+    }
+    new_parent->children.push_back(w);
+    window->parent = parent;
+    window->x = x;
+    window->y = y;
+    XEvent event = NewEvent(ReparentNotify);
+    event.xreparent.window = w;
+    event.xreparent.parent = parent;
+    event.xreparent.x = x;
+    event.xreparent.y = y;
+    event.xreparent.override_redirect = window->override_redirect;
+    if (window->event_mask & StructureNotifyMask) {
+        Deliver(event, w);
+    }
+    const FakeWindow* old = Find(old_parent);
+    if (old != nullptr && (old->event_mask & SubstructureNotifyMask)) {
+        Deliver(event, old_parent);
+    }
+    if (new_parent->event_mask & SubstructureNotifyMask) {
+        Deliver(event, parent);
+    }
+    if (was_mapped) {
+        DoMap(w, *window);
+    }
+}
+
+void FakeXServer::ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) {
+    ++requests_;
+    if (FakeWindow* window = Target(w)) {
+        DoConfigure(w, *window, value_mask, changes);
+    }
+}
+
+void FakeXServer::MoveWindow(Window w, int x, int y) {
+    XWindowChanges changes;
+    changes.x = x;
+    changes.y = y;
+    ConfigureWindow(w, CWX | CWY, changes);
+}
+
+void FakeXServer::ResizeWindow(Window w, unsigned int width, unsigned int height) {
+    XWindowChanges changes;
+    changes.width = width;
+    changes.height = height;
+    ConfigureWindow(w, CWWidth | CWHeight, changes);
+}
+
+void FakeXServer::MoveResizeWindow(Window w, int x, int y, unsigned int width, unsigned int height) {
+    XWindowChanges changes;
+    changes.x = x;
+    changes.y = y;
+    changes.width = width;
+    changes.height = height;
+    ConfigureWindow(w, CWX | CWY | CWWidth | CWHeight, changes);
+}
+
+void FakeXServer::RaiseWindow(Window w) {
+    XWindowChanges changes;
+    changes.stack_mode = Above;
+    ConfigureWindow(w, CWStackMode, changes);
+}
+
+void FakeXServer::SelectInput(Window w, long event_mask) {
+    ++requests_;
+    if (FakeWindow* window = Target(w)) {
+        window->event_mask = event_mask;
+    }
+}
+
+void FakeXServer::SetInputFocus(Window w) {
+    ++requests_;
+    if (Target(w) != nullptr) {
+        DoFocus(w);
+    }
+}
+
+void FakeXServer::DoFocus(Window w) {
+    if (w == focus_) {
+        return;
+    }
+    if (const FakeWindow* old = Find(focus_)) {
+        if (old->event_mask & FocusChangeMask) {
+            XEvent event = NewEvent(FocusOut);
+            event.xfocus.mode = NotifyNormal;
+            event.xfocus.detail = NotifyNonlinear;
+            Deliver(event, focus_);
+        }
+    }
+    focus_ = w;
+    if (Find(w)->event_mask & FocusChangeMask) {
+        XEvent event = NewEvent(FocusIn);
+        event.xfocus.mode = NotifyNormal;
+        event.xfocus.detail = NotifyNonlinear;
+        Deliver(event, w);
+    }
+}
+
+bool FakeXServer::SendEvent(Window w, const XEvent& event) {
+    ++requests_;
+    ++sent_events_;
+    return Target(w) != nullptr;
+}
+
+/* The client goes away, and its windows with it. */
+void FakeXServer::KillClient(Window w) {
+    ++requests_;
+    if (w != ROOT && Target(w) != nullptr) {
+        DoDestroy(w);
+    }
+}
+
+void FakeXServer::ReadProperties(const FakeWindow& window, unsigned int properties, const AtomRegistry& atoms, WindowProperties* into) {
+    for (unsigned int bit = 1; bit <= properties; bit <<= 1) {
+        if (!(properties & bit)) {
+            continue;
+        }
+        ++requests_;
+        const auto i = window.properties.find(PropertyAtom(bit, atoms));
+        if (i == window.properties.end()) {
+            ParseProperty(bit, 0, nullptr, 0, sizeof(long), into);
+        } else {
+            ParseProperty(bit, i->second.format, i->second.data.data(), i->second.count, sizeof(long), into);
+        }
+    }
+}
+
+vector<WindowInfo> FakeXServer::FetchWindowInfo(const vector<Window>& windows, const AtomRegistry& atoms) {
+    vector<WindowInfo> infos(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        WindowInfo& info = infos[i];
+        info.window = windows[i];
+        requests_ += 2;
+        const FakeWindow* window = Target(windows[i]);
+        info.valid = window != nullptr;
+        if (!info.valid) {
+            continue;
+        }
+        info.position = Position<int>(window->x, window->y);
+        info.size = Size<int>(window->width, window->height);
+        info.border_width = window->border_width;
+        info.mapped = window->mapped;
+        info.override_redirect = window->override_redirect;
+        ReadProperties(*window, ALL_PROPERTIES, atoms, &info.properties);
+    }
+    return infos;
+}
+
+void FakeXServer::FetchProperties(const vector<PropertyFetch>& fetches, const AtomRegistry& atoms) {
+    for (const PropertyFetch& fetch : fetches) {
+        const FakeWindow* window = Target(fetch.window);
+        if (window == nullptr) {
+            ++requests_;
+            continue;
+        }
+        ReadProperties(*window, fetch.properties, atoms, fetch.into);
+    }
+}
+
+bool FakeXServer::QueryChildren(Window w, vector<Window>* children) {
+    ++requests_;
+    const FakeWindow* window = Target(w);
+    if (window == nullptr) {
+        return false;
+    }
+    *children = window->children;
+    return true;
+}
+
+/* Atoms after the predefined ones, numbered in order of first use. */
+vector<Atom> FakeXServer::InternAtoms(const vector<string>& names) {
+    vector<Atom> atoms;
+    for (const string& name : names) {
+        ++requests_;
+        const auto i = atoms_.emplace(name, XA_LAST_PREDEFINED + 1 + atoms_.size());
+        atoms.push_back(i.first->second);
+    }
+    return atoms;
+}
+
+bool FakeXServer::GetWindowAttributes(Window w, XWindowAttributes* attributes) {
+    ++requests_;
+    const FakeWindow* window = Target(w);
+    if (window == nullptr) {
+        return false;
+    }
+    memset(attributes, 0, sizeof(*attributes));
+    attributes->x = window->x;
+    attributes->y = window->y;
+    attributes->width = window->width;
+    attributes->height = window->height;
+    attributes->border_width = window->border_width;
+    attributes->override_redirect = window->override_redirect;
+    attributes->root = ROOT;
+    attributes->your_event_mask = window->event_mask;
+    attributes->map_state = IsUnmapped;
+    if (window->mapped) {
+        attributes->map_state = IsViewable;
+        for (const FakeWindow* p = Find(window->parent); p != nullptr; p = Find(p->parent)) {
+            if (!p->mapped) {
+                attributes->map_state = IsUnviewable;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool FakeXServer::GetCardinalProperty(Window w, Atom property, unsigned long* value) {
+    ++requests_;
+    const FakeWindow* window = Target(w);
+    if (window == nullptr) {
+        return false;
+    }
+    const auto i = window->properties.find(property);
+    if (i == window->properties.end() || i->second.type != XA_CARDINAL || i->second.format != 32 || i->second.count != 1) {
+        return false;
+    }
+    *value = *reinterpret_cast<const unsigned long*>(i->second.data.data());
+    return true;
+}
+
+/* Keycodes are handed out on first lookup, starting where real ones do. */
+KeyCode FakeXServer::KeysymToKeycode(KeySym keysym) {
+    auto i = find(keymap_.begin(), keymap_.end(), keysym);
+    if (i == keymap_.end()) {
+        if (keymap_.size() >= 248) {
+            return 0;
+        }
+        keymap_.push_back(keysym);
+        i = keymap_.end() - 1;
+    }
+    return 8 + (i - keymap_.begin());
+}
+
+KeySym FakeXServer::KeycodeToKeysym(KeyCode keycode) {
+    return keycode >= 8 && static_cast<size_t>(keycode - 8) < keymap_.size() ? keymap_[keycode - 8] : NoSymbol;
+}
+
+Window FakeXServer::ClientCreateWindow(int x, int y, unsigned int width, unsigned int height, bool override_redirect) {
+    return NewWindow(ROOT, next_client_window_++, x, y, width, height, 0, override_redirect);
+}
+
+void FakeXServer::ClientMapWindow(Window w) {
+    FakeWindow* window = Find(w);
+    if (window == nullptr || window->mapped) {
+        return;
+    }
+    if (Redirected(*window)) {
+        XEvent event = NewEvent(MapRequest);
+        event.xmaprequest.window = w;
+        Deliver(event, window->parent);
+        return;
+    }
+    DoMap(w, *window);
+}
+
+void FakeXServer::ClientUnmapWindow(Window w) {
+    if (FakeWindow* window = Find(w)) {
+        DoUnmap(w, *window);
+    }
+}
+
+void FakeXServer::ClientConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) {
+    FakeWindow* window = Find(w);
+    if (window == nullptr) {
+        return;
+    }
+    if (Redirected(*window)) {
+        XEvent event = NewEvent(ConfigureRequest);
+        event.xconfigurerequest.window = w;
+        event.xconfigurerequest.x = changes.x;
+        event.xconfigurerequest.y = changes.y;
+        event.xconfigurerequest.width = changes.width;
+        event.xconfigurerequest.height = changes.height;
+        event.xconfigurerequest.border_width = changes.border_width;
+        event.xconfigurerequest.above = changes.sibling;
+        event.xconfigurerequest.detail = changes.stack_mode;
+        event.xconfigurerequest.value_mask = value_mask;
+        Deliver(event, window->parent);
+        return;
+    }
+    DoConfigure(w, *window, value_mask, changes);
+}
+
+void FakeXServer::ClientDestroyWindow(Window w) {
+    if (w != ROOT) {
+        DoDestroy(w);
+    }
+}
+
+void FakeXServer::ClientSetInputFocus(Window w) {
+    if (Find(w) != nullptr) {
+        DoFocus(w);
+    }
+}
+
+void FakeXServer::ClientSetClass(Window w, const string& res_name, const string& res_class) {
+    const string value = res_name + '\0' + res_class + '\0';
+    ClientSetProperty(w, XA_WM_CLASS, XA_STRING, 8, value.data(), value.size());
+}
+
+void FakeXServer::ClientSetProtocols(Window w, const vector<Atom>& protocols) {
+    ClientSetProperty(w, InternAtoms({"WM_PROTOCOLS"})[0], XA_ATOM, 32, protocols.data(), protocols.size());
+}
+
+void FakeXServer::ClientSetProperty(Window w, Atom property, Atom type, int format, const void* data, size_t count) {
+    FakeWindow* window = Find(w);
+    if (window != nullptr) {
+        SetProperty(w, *window, property, type, format, PropModeReplace, data, count);
+    }
+}
+
+/* Format 32 data is an array of longs, as in Xlib. Appending to or
+ * prepending to a property of another type or format is a BadMatch, which
+ * is counted as an error and leaves the property alone. */
+void FakeXServer::SetProperty(Window w, FakeWindow& window, Atom property, Atom type, int format, int mode, const void* data, size_t count) {
+    const auto existing = window.properties.find(property);
+    if (mode != PropModeReplace && existing != window.properties.end() &&
+        (existing->second.type != type || existing->second.format != format)) {
+        ++errors_;
+        return;
+    }
+    Property& p = window.properties[property];
+    const size_t size = format == 32 ? sizeof(long) : format / 8;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    if (mode == PropModeReplace || existing == window.properties.end()) {
+        p.data.assign(bytes, bytes + count * size);
+        p.count = count;
+    } else if (mode == PropModeAppend) {
+        p.data.insert(p.data.end(), bytes, bytes + count * size);
+        p.count += count;
+    } else {
+        p.data.insert(p.data.begin(), bytes, bytes + count * size);
+        p.count += count;
+    }
+    p.type = type;
+    p.format = format;
+    if (window.event_mask & PropertyChangeMask) {
+        XEvent event = NewEvent(PropertyNotify);
+        event.xproperty.atom = property;
+        event.xproperty.state = PropertyNewValue;
+        Deliver(event, w);
+    }
+}
+
+void FakeXServer::ChangeProperty(Window w, Atom property, Atom type, int format, int mode, const void* data, int count) {
+    ++requests_;
+    FakeWindow* window = Target(w);
+    if (window != nullptr) {
+        SetProperty(w, *window, property, type, format, mode, data, count);
+    }
+}
+
+vector<unsigned long> FakeXServer::Property32(Window w, Atom property) const {
+    const FakeWindow* window = Find(w);
+    if (window == nullptr) {
+        return {};
+    }
+    const auto i = window->properties.find(property);
+    if (i == window->properties.end() || i->second.format != 32) {
+        return {};
+    }
+    const unsigned long* items = reinterpret_cast<const unsigned long*>(i->second.data.data());
+    return vector<unsigned long>(items, items + i->second.count);
+}
+
+void FakeXServer::QueueEvent(const XEvent& event) {
+    events_.push_back(event);
+}
+
+Window FakeXServer::Parent(Window w) const {
+    const FakeWindow* window = Find(w);
+    return window ? window->parent : None;
+}
+
+bool FakeXServer::Mapped(Window w) const {
+    const FakeWindow* window = Find(w);
+    return window != nullptr && window->mapped;
+}
+
+Rect FakeXServer::Geometry(Window w) const {
+    const FakeWindow* window = Find(w);
+    if (window == nullptr) {
+        return Rect{0, 0, 0, 0};
+    }
+    return Rect{window->x, window->y, static_cast<int>(window->width), static_cast<int>(window->height)};
+}
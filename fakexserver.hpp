@@ -0,0 +1,176 @@
+#ifndef FAKEXSERVER_HPP
+#define FAKEXSERVER_HPP
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "layout.hpp"
+#include "xconnection.hpp"
+
+// An X server in memory, for running the handlers millions of times with
+// no display. It models the window tree with stacking order, geometry, map
+// state, the WM's event selection and properties, and queues the events a
+// real server would send the WM in answer to its requests (MapNotify after
+// a map, ReparentNotify after a reparent, MapRequest when a client maps a
+// window under a redirecting parent, ...). Expose, crossing and pointer
+// events are not modelled; input is queued by hand with QueueEvent.
+//
+// The Client* calls play the part of other clients; the XConnection calls
+// are the WM's own requests and are never redirected.
+class FakeXServer : public XConnection {
+	public:
+		explicit FakeXServer(int width = 1920, int height = 1080);
+
+		Display* display() override { return nullptr; }
+		std::string name() const override { return "fake"; }
+		Window root() const override { return ROOT; }
+		Size<int> screen_size() const override { return screen_; }
+		int fd() const override { return -1; }
+		unsigned long NextRequestSerial() override { return requests_ + 1; }
+		void Flush() override {}
+		void Sync() override { ++requests_; }
+		// Batches are modelled on the default XCB backend.
+		bool pipelined() const override { return true; }
+
+		int Pending() override { return events_.size(); }
+		void NextEvent(XEvent* event) override;
+		bool CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) override;
+		int QueuedEvents() override { return events_.size(); }
+
+		Window CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+		                    unsigned int border_width, unsigned long border, unsigned long background) override;
+		void DestroyWindow(Window w) override;
+		void MapWindow(Window w) override;
+		void UnmapWindow(Window w) override;
+		void ReparentWindow(Window w, Window parent, int x, int y) override;
+		void ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) override;
+		void MoveWindow(Window w, int x, int y) override;
+		void ResizeWindow(Window w, unsigned int width, unsigned int height) override;
+		void MoveResizeWindow(Window w, int x, int y, unsigned int width, unsigned int height) override;
+		void RaiseWindow(Window w) override;
+		void SelectInput(Window w, long event_mask) override;
+		void AddToSaveSet(Window w) override { ++requests_; }
+		void RemoveFromSaveSet(Window w) override { ++requests_; }
+		void SetInputFocus(Window w) override;
+		bool SendEvent(Window w, const XEvent& event) override;
+		void KillClient(Window w) override;
+		void ChangeProperty(Window w, Atom property, Atom type, int format, int mode, const void* data, int count) override;
+
+		std::vector<WindowInfo> FetchWindowInfo(const std::vector<Window>& windows, const AtomRegistry& atoms) override;
+		void FetchProperties(const std::vector<PropertyFetch>& fetches, const AtomRegistry& atoms) override;
+		bool QueryChildren(Window w, std::vector<Window>* children) override;
+		std::vector<Atom> InternAtoms(const std::vector<std::string>& names) override;
+		bool GetWindowAttributes(Window w, XWindowAttributes* attributes) override;
+		bool GetCardinalProperty(Window w, Atom property, unsigned long* value) override;
+
+		void GrabServer() override { ++requests_; }
+		void UngrabServer() override { ++requests_; }
+		bool GrabKeyboard() override { ++requests_; return true; }
+		void UngrabKeyboard() override { ++requests_; }
+		void GrabKey(KeyCode keycode, unsigned int modifiers) override { ++requests_; }
+		void UngrabAllKeys() override { ++requests_; }
+		void GrabButton(unsigned int button, unsigned int modifiers, unsigned int event_mask) override { ++requests_; }
+
+		KeyCode KeysymToKeycode(KeySym keysym) override;
+		KeySym KeycodeToKeysym(KeyCode keycode) override;
+		void RefreshKeyboardMapping(XMappingEvent* event) override {}
+
+		void DrawOutline(int x, int y, unsigned int width, unsigned int height) override { ++requests_; }
+
+		// No SYNC extension: sync resizes fall back to live ones.
+		bool QuerySync(int* event_base) override { return false; }
+		bool QueryCounter(XSyncCounter counter, int64_t* value) override { return false; }
+		XSyncAlarm CreateAlarm(XSyncCounter counter, int64_t value) override { return None; }
+		void ChangeAlarm(XSyncAlarm alarm, int64_t value) override {}
+		void DestroyAlarm(XSyncAlarm alarm) override {}
+
+		// Other clients. A map or configure of a window whose parent the WM
+		// redirects turns into a MapRequest or ConfigureRequest.
+		Window ClientCreateWindow(int x, int y, unsigned int width, unsigned int height, bool override_redirect = false);
+		void ClientMapWindow(Window w);
+		void ClientUnmapWindow(Window w);
+		void ClientConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes);
+		void ClientDestroyWindow(Window w);
+		// A client taking the focus itself, as with a click to focus.
+		void ClientSetInputFocus(Window w);
+		void ClientSetClass(Window w, const std::string& res_name, const std::string& res_class);
+		void ClientSetProtocols(Window w, const std::vector<Atom>& protocols);
+		// Queues a PropertyNotify if the WM selected PropertyChangeMask.
+		void ClientSetProperty(Window w, Atom property, Atom type, int format, const void* data, size_t count);
+		// Puts an event (input, usually) at the end of the queue.
+		void QueueEvent(const XEvent& event);
+		void DiscardEvents() { events_.clear(); }
+
+		// Inspection.
+		bool Exists(Window w) const { return windows_.count(w) != 0; }
+		Window Parent(Window w) const;
+		bool Mapped(Window w) const;
+		Rect Geometry(Window w) const;
+		Window focus() const { return focus_; }
+		// The items of a format 32 property, empty if it is not set.
+		std::vector<unsigned long> Property32(Window w, Atom property) const;
+		size_t window_count() const { return windows_.size(); }
+		// Requests the WM has sent, and how many named a window that does
+		// not exist (BadWindow on a real server).
+		unsigned long requests() const { return requests_; }
+		unsigned long errors() const { return errors_; }
+		unsigned long sent_events() const { return sent_events_; }
+
+	private:
+		static const Window ROOT = 0x100;
+		struct Property {
+			Atom type;
+			int format;
+			std::vector<unsigned char> data;
+			size_t count;
+		};
+		struct FakeWindow {
+			Window parent;
+			// Bottom to top.
+			std::vector<Window> children;
+			int x, y;
+			unsigned int width, height, border_width;
+			bool mapped;
+			bool override_redirect;
+			// What the WM selected on this window.
+			long event_mask;
+			std::map<Atom, Property> properties;
+		};
+
+		FakeWindow* Find(Window w);
+		const FakeWindow* Find(Window w) const;
+		// Find for a window named in a request; a missing one is an error.
+		FakeWindow* Target(Window w);
+		Window NewWindow(Window parent, Window id, int x, int y, unsigned int width, unsigned int height,
+		                 unsigned int border_width, bool override_redirect);
+		bool Redirected(const FakeWindow& window) const;
+		// Queues a structure event about window, once to the window itself
+		// if it selected StructureNotify and once to its parent if that
+		// selected SubstructureNotify. The event field of every structure
+		// event sits where xany.window does, so that is what is filled in.
+		void Notify(const XEvent& event, const FakeWindow& window, Window w);
+		void Deliver(XEvent event, Window to);
+		void DoMap(Window w, FakeWindow& window);
+		void DoUnmap(Window w, FakeWindow& window);
+		void DoConfigure(Window w, FakeWindow& window, unsigned int value_mask, const XWindowChanges& changes);
+		void DoDestroy(Window w);
+		void DoFocus(Window w);
+		void SetProperty(Window w, FakeWindow& window, Atom property, Atom type, int format, int mode, const void* data, size_t count);
+		// ParseProperty for each bit in properties, from what window holds.
+		void ReadProperties(const FakeWindow& window, unsigned int properties, const AtomRegistry& atoms, WindowProperties* into);
+		XEvent NewEvent(int type);
+
+		Size<int> screen_;
+		std::unordered_map<Window, FakeWindow> windows_;
+		std::deque<XEvent> events_;
+		std::unordered_map<std::string, Atom> atoms_;
+		std::vector<KeySym> keymap_;
+		Window next_wm_window_;
+		Window next_client_window_;
+		Window focus_;
+		unsigned long requests_;
+		unsigned long errors_;
+		unsigned long sent_events_;
+};
+#endif
@@ -0,0 +1,110 @@
+#ifndef FOCUSRING_HPP
+#define FOCUSRING_HPP
+#include <cstddef>
+#include <cstdint>
+
+// Links embedded in a client record (intrusive), so moving a client around
+// the ring never allocates or searches. Links are slot indices into the
+// array that holds the records, which keeps them valid when that array
+// grows; FocusRing::Relocate fixes them up when a record itself moves.
+struct FocusNode {
+	static const uint32_t NIL = UINT32_MAX;
+	uint32_t prev = NIL;
+	uint32_t next = NIL;
+};
+
+// Most-recently-used focus order as a circular doubly linked list over a
+// random-access container of FocusNode-derived records. front() is the
+// most recently focused slot; next walks towards less recently focused
+// ones and wraps around. Every operation is O(1).
+class FocusRing {
+	public:
+		FocusRing() : head_(FocusNode::NIL), size_(0) {}
+		uint32_t front() const { return head_; }
+		size_t size() const { return size_; }
+
+		template <typename Nodes>
+		void PushBack(Nodes& nodes, uint32_t i);
+		template <typename Nodes>
+		void PushFront(Nodes& nodes, uint32_t i);
+		template <typename Nodes>
+		void Remove(Nodes& nodes, uint32_t i);
+		// Moves slot i to the front, inserting it if it is not in the ring.
+		template <typename Nodes>
+		void Touch(Nodes& nodes, uint32_t i);
+		// The record in slot from now lives in slot to.
+		template <typename Nodes>
+		void Relocate(Nodes& nodes, uint32_t from, uint32_t to);
+
+	private:
+		uint32_t head_;
+		size_t size_;
+};
+
+//implementation
+
+template <typename Nodes>
+void FocusRing::PushBack(Nodes& nodes, uint32_t i) {
+	if (head_ == FocusNode::NIL) {
+		nodes[i].prev = nodes[i].next = i;
+		head_ = i;
+	} else {
+		const uint32_t tail = nodes[head_].prev;
+		nodes[i].next = head_;
+		nodes[i].prev = tail;
+		nodes[tail].next = i;
+		nodes[head_].prev = i;
+	}
+	++size_;
+}
+
+template <typename Nodes>
+void FocusRing::PushFront(Nodes& nodes, uint32_t i) {
+	PushBack(nodes, i);
+	head_ = i;
+}
+
+template <typename Nodes>
+void FocusRing::Remove(Nodes& nodes, uint32_t i) {
+	if (nodes[i].next == FocusNode::NIL) {
+		return;
+	}
+	if (nodes[i].next == i) {
+		head_ = FocusNode::NIL;
+	} else {
+		nodes[nodes[i].prev].next = nodes[i].next;
+		nodes[nodes[i].next].prev = nodes[i].prev;
+		if (head_ == i) {
+			head_ = nodes[i].next;
+		}
+	}
+	nodes[i].prev = nodes[i].next = FocusNode::NIL;
+	--size_;
+}
+
+template <typename Nodes>
+void FocusRing::Touch(Nodes& nodes, uint32_t i) {
+	if (head_ == i) {
+		return;
+	}
+	Remove(nodes, i);
+	PushFront(nodes, i);
+}
+
+template <typename Nodes>
+void FocusRing::Relocate(Nodes& nodes, uint32_t from, uint32_t to) {
+	if (nodes[to].next == FocusNode::NIL) {
+		return;
+	}
+	if (nodes[to].next == from) {
+		/* Only member of the ring. */
+		nodes[to].prev = nodes[to].next = to;
+	} else {
+		nodes[nodes[to].prev].next = to;
+		nodes[nodes[to].next].prev = to;
+	}
+	if (head_ == from) {
+		head_ = to;
+	}
+}
+#endif
@@ -0,0 +1,146 @@
+#include "launcher.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+extern "C" {
+#include <signal.h>
+#include <spawn.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+using namespace std;
+
+extern char** environ;
+
+Launcher::Launcher() :
+    signal_fd_(-1),
+    launches_(0),
+    failures_(0),
+    total_spawn_time_(0),
+    max_spawn_time_(0) {
+    /* SIGCHLD has to be blocked for signalfd to see it. Threads started
+     * later inherit the mask. */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0) {
+        cerr << "signalfd failed, children will not be reaped: " << strerror(errno) << endl;
+    }
+}
+
+Launcher::~Launcher() {
+    if (signal_fd_ >= 0) {
+        close(signal_fd_);
+    }
+}
+
+pid_t Launcher::Launch(const vector<string>& argv, const vector<pair<string, string>>& env) {
+    if (argv.empty()) {
+        return -1;
+    }
+    vector<char*> c_argv;
+    for (const string& arg : argv) {
+        c_argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    c_argv.push_back(nullptr);
+
+    vector<string> env_strings;
+    vector<char*> c_env;
+    char** envp = environ;
+    if (!env.empty()) {
+        for (char** e = environ; *e != nullptr; ++e) {
+            const char* eq = strchr(*e, '=');
+            const size_t name_length = eq ? eq - *e : strlen(*e);
+            const bool overridden = any_of(env.begin(), env.end(), [&](const pair<string, string>& o) {
+                return o.first.size() == name_length && o.first.compare(0, name_length, *e, name_length) == 0;
+            });
+            if (!overridden) {
+                c_env.push_back(*e);
+            }
+        }
+        for (const auto& o : env) {
+            env_strings.push_back(o.first + "=" + o.second);
+        }
+        for (string& s : env_strings) {
+            c_env.push_back(&s[0]);
+        }
+        c_env.push_back(nullptr);
+        envp = c_env.data();
+    }
+
+    /* Children get a clean signal mask and default dispositions, and their
+     * own process group so terminal signals meant for the WM skip them. */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGHUP);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    const auto start = chrono::steady_clock::now();
+    pid_t pid;
+    const int error = posix_spawnp(&pid, c_argv[0], nullptr, &attr, c_argv.data(), envp);
+    const auto spawned = chrono::steady_clock::now();
+    posix_spawnattr_destroy(&attr);
+
+    if (error != 0) {
+        ++failures_;
+        cerr << "Failed to launch " << argv[0] << ": " << strerror(error) << endl;
+        return -1;
+    }
+    const chrono::nanoseconds spawn_time = spawned - start;
+    ++launches_;
+    total_spawn_time_ += spawn_time;
+    max_spawn_time_ = max(max_spawn_time_, spawn_time);
+    children_[pid] = make_pair(argv[0], spawned);
+    cerr << "Launched " << argv[0] << " (pid " << pid << ") in "
+         << chrono::duration_cast<chrono::microseconds>(spawn_time).count() << "us" << endl;
+    return pid;
+}
+
+pid_t Launcher::LaunchCommand(const string& command) {
+    string line = command;
+    while (!line.empty() && (line.back() == '&' || isspace(static_cast<unsigned char>(line.back())))) {
+        line.pop_back();
+    }
+    if (line.find_first_of("|&;<>()$`\\\"'*?[]#~=%{}\n") != string::npos) {
+        return Launch({"/bin/sh", "-c", line});
+    }
+    vector<string> argv;
+    istringstream words(line);
+    string word;
+    while (words >> word) {
+        argv.push_back(word);
+    }
+    return Launch(argv);
+}
+
+void Launcher::ReapChildren() {
+    struct signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+    }
+    /* Signals coalesce, so one SIGCHLD can stand for several exits. */
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        const auto child = children_.find(pid);
+        if (child == children_.end()) {
+            continue;
+        }
+        const auto lifetime = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - child->second.second);
+        cerr << child->second.first << " (pid " << pid << ") exited with status "
+             << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << " after " << lifetime.count() << "ms" << endl;
+        children_.erase(child);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef LAUNCHER_HPP
+#define LAUNCHER_HPP
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+extern "C" {
+#include <sys/types.h>
+}
+
+// Spawns programs without blocking the event loop. Children are started
+// with posix_spawn and reaped when SIGCHLD shows up on signal_fd(), which
+// the WM polls alongside the X connection.
+class Launcher {
+	public:
+		Launcher();
+		~Launcher();
+
+		// Runs argv[0] from PATH with argv; env overrides are NAME, VALUE
+		// pairs applied on top of the WM's environment. Returns the pid,
+		// or -1 if the spawn failed.
+		pid_t Launch(const std::vector<std::string>& argv,
+		             const std::vector<std::pair<std::string, std::string>>& env = {});
+		// Runs a command line, going through /bin/sh only if it uses shell
+		// syntax. A trailing '&' is accepted and ignored.
+		pid_t LaunchCommand(const std::string& command);
+		// Reaps every exited child. Call when signal_fd() is readable.
+		void ReapChildren();
+		int signal_fd() const { return signal_fd_; }
+
+		unsigned long launches() const { return launches_; }
+		unsigned long failures() const { return failures_; }
+		std::chrono::nanoseconds total_spawn_time() const { return total_spawn_time_; }
+		std::chrono::nanoseconds max_spawn_time() const { return max_spawn_time_; }
+
+	private:
+		int signal_fd_;
+		std::unordered_map<pid_t, std::pair<std::string, std::chrono::steady_clock::time_point>> children_;
+		unsigned long launches_;
+		unsigned long failures_;
+		std::chrono::nanoseconds total_spawn_time_;
+		std::chrono::nanoseconds max_spawn_time_;
+};
+#endif
@@ -0,0 +1,185 @@
+#include "layout.hpp"
+#include <algorithm>
+using namespace std;
+
+/* No tile is resized below this share of its split. */
+static const float MIN_RATIO = 0.05f;
+
+TilingLayout::TilingLayout() :
+    root_(NIL),
+    last_inserted_(None),
+    area_{0, 0, 0, 0} {
+}
+
+void TilingLayout::SetArea(const Rect& area) {
+    area_ = area;
+    if (root_ != NIL) {
+        nodes_[root_].rect = area;
+        MarkDirty(root_);
+    }
+}
+
+void TilingLayout::Insert(Window window, Window near) {
+    if (Contains(window)) {
+        return;
+    }
+    const uint32_t leaf = NewNode();
+    nodes_[leaf].window = window;
+    leaves_.Set(window, leaf);
+    uint32_t target = leaves_.Find(near);
+    if (target == WindowIndex::NOT_FOUND) {
+        target = leaves_.Find(last_inserted_);
+    }
+    last_inserted_ = window;
+    if (target == WindowIndex::NOT_FOUND) {
+        root_ = leaf;
+        nodes_[leaf].rect = area_;
+        MarkDirty(leaf);
+        return;
+    }
+    const uint32_t split = NewNode();
+    Node& s = nodes_[split];
+    const Rect rect = nodes_[target].rect;
+    s.rect = rect;
+    s.side_by_side = rect.width >= rect.height;
+    s.first = target;
+    s.second = leaf;
+    Replace(target, split);
+    nodes_[target].parent = split;
+    nodes_[leaf].parent = split;
+    MarkDirty(split);
+}
+
+void TilingLayout::Remove(Window window) {
+    const uint32_t leaf = leaves_.Find(window);
+    if (leaf == WindowIndex::NOT_FOUND) {
+        return;
+    }
+    leaves_.Erase(window);
+    if (last_inserted_ == window) {
+        last_inserted_ = None;
+    }
+    const uint32_t parent = nodes_[leaf].parent;
+    if (parent == NIL) {
+        root_ = NIL;
+        FreeNode(leaf);
+        return;
+    }
+    const uint32_t sibling = nodes_[parent].first == leaf ? nodes_[parent].second : nodes_[parent].first;
+    nodes_[sibling].rect = nodes_[parent].rect;
+    Replace(parent, sibling);
+    FreeNode(leaf);
+    FreeNode(parent);
+    MarkDirty(sibling);
+}
+
+void TilingLayout::Resize(Window window, const Size<int>& size) {
+    const uint32_t leaf = leaves_.Find(window);
+    if (leaf == WindowIndex::NOT_FOUND || nodes_[leaf].parent == NIL) {
+        return;
+    }
+    Node& parent = nodes_[nodes_[leaf].parent];
+    const int extent = parent.side_by_side ? parent.rect.width : parent.rect.height;
+    if (extent <= 0) {
+        return;
+    }
+    const float share = static_cast<float>(parent.side_by_side ? size.width : size.height) / extent;
+    const float ratio = parent.first == leaf ? share : 1.0f - share;
+    parent.ratio = min(1.0f - MIN_RATIO, max(MIN_RATIO, ratio));
+    MarkDirty(nodes_[leaf].parent);
+}
+
+const Rect* TilingLayout::TileOf(Window window) const {
+    const uint32_t leaf = leaves_.Find(window);
+    return leaf == WindowIndex::NOT_FOUND ? nullptr : &nodes_[leaf].applied;
+}
+
+const vector<LayoutChange>& TilingLayout::Update() {
+    changes_.clear();
+    /* A subtree that was already arranged as part of a dirty ancestor has
+     * its flag cleared and is skipped. */
+    for (uint32_t i : dirty_) {
+        if (nodes_[i].dirty) {
+            Arrange(i, nodes_[i].rect);
+        }
+    }
+    dirty_.clear();
+    for (uint32_t i : touched_) {
+        Node& leaf = nodes_[i];
+        leaf.touched = false;
+        if (leaf.window != None && leaf.rect != leaf.applied) {
+            leaf.applied = leaf.rect;
+            changes_.push_back(LayoutChange{leaf.window, leaf.rect});
+        }
+    }
+    touched_.clear();
+    return changes_;
+}
+
+uint32_t TilingLayout::NewNode() {
+    uint32_t i;
+    if (!free_.empty()) {
+        i = free_.back();
+        free_.pop_back();
+    } else {
+        i = nodes_.size();
+        nodes_.emplace_back();
+    }
+    nodes_[i] = Node{NIL, NIL, NIL, None, false, false, false, 0.5f, {0, 0, 0, 0}, {0, 0, 0, 0}};
+    return i;
+}
+
+void TilingLayout::FreeNode(uint32_t i) {
+    /* Freed nodes may still be queued in dirty_ or touched_. */
+    nodes_[i].window = None;
+    nodes_[i].dirty = false;
+    free_.push_back(i);
+}
+
+/* Puts new_child where old_child hangs in the tree. */
+void TilingLayout::Replace(uint32_t old_child, uint32_t new_child) {
+    const uint32_t parent = nodes_[old_child].parent;
+    nodes_[new_child].parent = parent;
+    if (parent == NIL) {
+        root_ = new_child;
+    } else if (nodes_[parent].first == old_child) {
+        nodes_[parent].first = new_child;
+    } else {
+        nodes_[parent].second = new_child;
+    }
+}
+
+void TilingLayout::MarkDirty(uint32_t i) {
+    if (!nodes_[i].dirty) {
+        nodes_[i].dirty = true;
+        dirty_.push_back(i);
+    }
+}
+
+void TilingLayout::Arrange(uint32_t i, const Rect& rect) {
+    Node& node = nodes_[i];
+    node.rect = rect;
+    node.dirty = false;
+    if (node.first == NIL) {
+        if (!node.touched) {
+            node.touched = true;
+            touched_.push_back(i);
+        }
+        return;
+    }
+    Rect first = rect;
+    Rect second = rect;
+    if (node.side_by_side) {
+        first.width = static_cast<int>(rect.width * node.ratio);
+        second.x = rect.x + first.width;
+        second.width = rect.width - first.width;
+    } else {
+        first.height = static_cast<int>(rect.height * node.ratio);
+        second.y = rect.y + first.height;
+        second.height = rect.height - first.height;
+    }
+    const uint32_t a = node.first;
+    const uint32_t b = node.second;
+    Arrange(a, first);
+    Arrange(b, second);
+}
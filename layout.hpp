@@ -0,0 +1,79 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+#include <cstdint>
+#include <vector>
+#include "clientstore.hpp"
+#include "eventnames.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+struct Rect {
+	int x, y, width, height;
+	bool operator==(const Rect& o) const { return x == o.x && y == o.y && width == o.width && height == o.height; }
+	bool operator!=(const Rect& o) const { return !(*this == o); }
+};
+
+struct LayoutChange {
+	Window window;
+	Rect rect;
+};
+
+// Binary split tiling layout. Each leaf is one window; each inner node
+// splits its rectangle between two children along its longer side. A new
+// window splits the tile of the window it is inserted next to, and removing
+// a window gives its tile back to its sibling.
+//
+// Edits only mark the subtree they affect; Update() re-arranges those
+// subtrees and reports the windows whose rectangles actually changed. No X
+// calls are made here.
+class TilingLayout {
+	public:
+		TilingLayout();
+		// The rectangle the whole tree is laid out in (usually the screen).
+		void SetArea(const Rect& area);
+		// Splits the tile of near, or of the most recently inserted window if
+		// near is not tiled.
+		void Insert(Window window, Window near);
+		void Remove(Window window);
+		// Moves the split next to window so its tile gets size along the split axis.
+		void Resize(Window window, const Size<int>& size);
+		bool Contains(Window window) const { return leaves_.Find(window) != WindowIndex::NOT_FOUND; }
+		// The last rectangle reported for window, or nullptr if it is not tiled.
+		const Rect* TileOf(Window window) const;
+		size_t size() const { return leaves_.size(); }
+		// Re-arranges everything touched since the last call. The result is
+		// valid until the next call.
+		const std::vector<LayoutChange>& Update();
+
+	private:
+		static const uint32_t NIL = UINT32_MAX;
+		struct Node {
+			uint32_t parent;
+			uint32_t first;
+			uint32_t second;
+			Window window;
+			bool side_by_side;
+			bool dirty;
+			bool touched;
+			float ratio;
+			Rect rect;
+			Rect applied;
+		};
+		uint32_t NewNode();
+		void FreeNode(uint32_t i);
+		void Replace(uint32_t old_child, uint32_t new_child);
+		void MarkDirty(uint32_t i);
+		void Arrange(uint32_t i, const Rect& rect);
+
+		std::vector<Node> nodes_;
+		std::vector<uint32_t> free_;
+		std::vector<uint32_t> dirty_;
+		std::vector<uint32_t> touched_;
+		std::vector<LayoutChange> changes_;
+		WindowIndex leaves_;
+		uint32_t root_;
+		Window last_inserted_;
+		Rect area_;
+};
+#endif
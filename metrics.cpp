@@ -0,0 +1,201 @@
+#include "metrics.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "control.hpp"
+#include "eventnames.hpp"
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+using namespace std;
+
+const int LatencyHistogram::SUB_BUCKETS;
+const int LatencyHistogram::MAX_EXPONENT;
+const int LatencyHistogram::BUCKETS;
+const int Metrics::EVENT_TYPES;
+
+LatencyHistogram::LatencyHistogram() :
+    count_(0),
+    sum_ns_(0),
+    max_ns_(0) {
+    memset(counts_, 0, sizeof(counts_));
+}
+
+uint64_t LatencyHistogram::LowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    const int exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + 4;
+    const uint64_t mantissa = SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return mantissa << (exponent - 4);
+}
+
+/* A sample is kept in the bucket of ns - 1, so the buckets whose lower
+ * bound is below ns hold exactly the samples of at most ns when ns is a
+ * bucket boundary. */
+uint64_t LatencyHistogram::CountAtMost(uint64_t ns) const {
+    uint64_t at_most = 0;
+    for (int i = 0; i < BUCKETS && LowerBound(i) < ns; ++i) {
+        at_most += counts_[i];
+    }
+    return at_most;
+}
+
+static const char* const TASK_NAMES[Metrics::TASKS] = {"OnMotionTimer", "OnControlCommand", "RefreshProperties"};
+
+Metrics::Metrics() :
+    pixels_painted_(0),
+    drags_(0),
+    drag_motion_events_(0),
+    drag_requests_(0) {
+}
+
+/* Cumulative buckets at powers of two from about 1us to 1s, which are
+ * bucket boundaries and so exact. */
+static void FormatHistogram(ostream& out, const string& name, const string& labels, const LatencyHistogram& h) {
+    const string separator = labels.empty() ? "" : ",";
+    for (int exponent = 10; exponent <= 30; ++exponent) {
+        out << name << "_bucket{" << labels << separator << "le=\"" << (1ull << exponent) / 1e9 << "\"} "
+            << h.CountAtMost(1ull << exponent) << "\n";
+    }
+    out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << h.count() << "\n";
+    const string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braces << " " << h.sum_ns() / 1e9 << "\n";
+    out << name << "_count" << braces << " " << h.count() << "\n";
+}
+
+string Metrics::Format(uint64_t events, uint64_t requests, uint64_t errors) const {
+    ostringstream out;
+    out << "# HELP lightwm_events_total X events dispatched.\n"
+        << "# TYPE lightwm_events_total counter\n"
+        << "lightwm_events_total " << events << "\n"
+        << "# HELP lightwm_x_requests_total X requests sent.\n"
+        << "# TYPE lightwm_x_requests_total counter\n"
+        << "lightwm_x_requests_total " << requests << "\n"
+        << "# HELP lightwm_x_errors_total X errors received.\n"
+        << "# TYPE lightwm_x_errors_total counter\n"
+        << "lightwm_x_errors_total " << errors << "\n";
+    out << "# HELP lightwm_handler_latency_seconds Time spent handling one event, by event type.\n"
+        << "# TYPE lightwm_handler_latency_seconds histogram\n";
+    for (int type = 0; type < EVENT_TYPES; ++type) {
+        if (by_type_[type]) {
+            FormatHistogram(out, "lightwm_handler_latency_seconds", "event=\"" + EventTypeName(type) + "\"", *by_type_[type]);
+        }
+    }
+    out << "# HELP lightwm_handler_latency_max_seconds Slowest event handled, by event type.\n"
+        << "# TYPE lightwm_handler_latency_max_seconds gauge\n";
+    for (int type = 0; type < EVENT_TYPES; ++type) {
+        if (by_type_[type]) {
+            out << "lightwm_handler_latency_max_seconds{event=\"" << EventTypeName(type) << "\"} " << by_type_[type]->max_ns() / 1e9 << "\n";
+        }
+    }
+    out << "# HELP lightwm_task_latency_seconds Time spent on one run of work outside the event handlers, by task.\n"
+        << "# TYPE lightwm_task_latency_seconds histogram\n";
+    for (int task = 0; task < TASKS; ++task) {
+        if (tasks_[task].count() > 0) {
+            FormatHistogram(out, "lightwm_task_latency_seconds", string("task=\"") + TASK_NAMES[task] + "\"", tasks_[task]);
+        }
+    }
+    out << "# HELP lightwm_task_latency_max_seconds Slowest run, by task.\n"
+        << "# TYPE lightwm_task_latency_max_seconds gauge\n";
+    for (int task = 0; task < TASKS; ++task) {
+        if (tasks_[task].count() > 0) {
+            out << "lightwm_task_latency_max_seconds{task=\"" << TASK_NAMES[task] << "\"} " << tasks_[task].max_ns() / 1e9 << "\n";
+        }
+    }
+    out << "# HELP lightwm_drags_total Drags finished.\n"
+        << "# TYPE lightwm_drags_total counter\n"
+        << "lightwm_drags_total " << drags_ << "\n"
+        << "# HELP lightwm_drag_motion_events_total Motion events received during drags.\n"
+        << "# TYPE lightwm_drag_motion_events_total counter\n"
+        << "lightwm_drag_motion_events_total " << drag_motion_events_ << "\n"
+        << "# HELP lightwm_drag_geometry_requests_total Geometry requests sent for drag motion.\n"
+        << "# TYPE lightwm_drag_geometry_requests_total counter\n"
+        << "lightwm_drag_geometry_requests_total " << drag_requests_ << "\n";
+    out << "# HELP lightwm_batch_latency_seconds Time spent on one batch of queued events, relayout included.\n"
+        << "# TYPE lightwm_batch_latency_seconds histogram\n";
+    FormatHistogram(out, "lightwm_batch_latency_seconds", "", batches_);
+    if (paints_.count() > 0) {
+        out << "# HELP lightwm_composite_pass_seconds Time spent issuing one compositor pass.\n"
+            << "# TYPE lightwm_composite_pass_seconds histogram\n";
+        FormatHistogram(out, "lightwm_composite_pass_seconds", "", paints_);
+        out << "# HELP lightwm_composite_pixels_total Pixels repainted by the compositor.\n"
+            << "# TYPE lightwm_composite_pixels_total counter\n"
+            << "lightwm_composite_pixels_total " << pixels_painted_ << "\n";
+    }
+    return out.str();
+}
+
+string DefaultMetricsSocketPath(const string& control_path) {
+    const char* path = getenv("LIGHTWM_METRICS_SOCKET");
+    if (path != nullptr) {
+        return path;
+    }
+    const string suffix = ".sock";
+    if (control_path.size() > suffix.size() && control_path.compare(control_path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        return control_path.substr(0, control_path.size() - suffix.size()) + ".metrics";
+    }
+    return control_path + ".metrics";
+}
+
+MetricsServer::MetricsServer(EventLoop& loop, function<string()> snapshot) :
+    loop_(loop),
+    snapshot_(snapshot),
+    listen_fd_(-1) {
+}
+
+MetricsServer::~MetricsServer() {
+    if (listen_fd_ >= 0) {
+        loop_.Remove(listen_fd_);
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool MetricsServer::Open(const string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Metrics socket path too long: " << path << endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    if (!PrepareSocketDirectory(path)) {
+        return false;
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        cerr << "Failed to create metrics socket: " << strerror(errno) << endl;
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || chmod(path.c_str(), 0600) < 0 ||
+        listen(listen_fd_, 8) < 0) {
+        cerr << "Failed to listen on " << path << ": " << strerror(errno) << endl;
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    path_ = path;
+    loop_.Add(listen_fd_, EPOLLIN, [this](uint32_t) { Accept(); });
+    return true;
+}
+
+/* A snapshot is some tens of kilobytes, well inside the default socket
+ * buffer, so it is written in one go and the connection closed at once. */
+void MetricsServer::Accept() {
+    int fd;
+    while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        const string text = snapshot_();
+        if (send(fd, text.data(), text.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(text.size())) {
+            cerr << "Metrics snapshot truncated" << endl;
+        }
+        close(fd);
+    }
+}
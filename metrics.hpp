@@ -0,0 +1,152 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "eventloop.hpp"
+
+// Latency histogram with HDR-style log-linear buckets: exact below 16ns,
+// then 16 buckets per power of two, so any value lands within about 6% of
+// its bucket's bounds. A bucket holds the values above its lower bound up
+// to and including the next one's, as Prometheus "le" buckets do.
+// Recording is a count-leading-zeros and an increment; nothing is
+// allocated after construction.
+class LatencyHistogram {
+	public:
+		static const int SUB_BUCKETS = 16;
+		// Up to 2^36ns (about 69s); slower samples go in the last bucket.
+		static const int MAX_EXPONENT = 36;
+		static const int BUCKETS = SUB_BUCKETS + (MAX_EXPONENT - 4 + 1) * SUB_BUCKETS;
+
+		LatencyHistogram();
+		void Record(uint64_t ns) {
+			++counts_[BucketOf(ns > 0 ? ns - 1 : 0)];
+			++count_;
+			sum_ns_ += ns;
+			if (ns > max_ns_) {
+				max_ns_ = ns;
+			}
+		}
+		uint64_t count() const { return count_; }
+		uint64_t sum_ns() const { return sum_ns_; }
+		uint64_t max_ns() const { return max_ns_; }
+		// Samples of at most ns. Exact when ns is a power of two.
+		uint64_t CountAtMost(uint64_t ns) const;
+
+		static int BucketOf(uint64_t ns) {
+			if (ns < SUB_BUCKETS) {
+				return ns;
+			}
+			const int exponent = 63 - __builtin_clzll(ns);
+			if (exponent > MAX_EXPONENT) {
+				return BUCKETS - 1;
+			}
+			return SUB_BUCKETS + (exponent - 4) * SUB_BUCKETS + ((ns >> (exponent - 4)) & (SUB_BUCKETS - 1));
+		}
+		static uint64_t LowerBound(int bucket);
+
+	private:
+		uint64_t counts_[BUCKETS];
+		uint64_t count_;
+		uint64_t sum_ns_;
+		uint64_t max_ns_;
+};
+
+// Handler latency per event type plus the WM's counters, always on.
+// Format() renders them in the Prometheus text exposition format.
+class Metrics {
+	public:
+		// Core event types are below 64 and extension events (SYNC alarms,
+		// Damage) below 128.
+		static const int EVENT_TYPES = 128;
+
+		// Work that runs outside any event's handler, timed the same way.
+		enum Task {
+			TASK_MOTION_TIMER,
+			TASK_CONTROL_COMMAND,
+			TASK_REFRESH_PROPERTIES,
+			TASKS,
+		};
+
+		Metrics();
+		void RecordEvent(int type, uint64_t ns) {
+			if (type >= 0 && type < EVENT_TYPES) {
+				Histogram(type).Record(ns);
+			}
+		}
+		// One pass of ProcessXEvents: the whole batch plus the relayout.
+		void RecordBatch(uint64_t ns) { batches_.Record(ns); }
+		void RecordTask(Task task, uint64_t ns) { tasks_[task].Record(ns); }
+		// One compositor pass, from its first request to its last; the
+		// server paints afterwards.
+		void RecordPaint(uint64_t ns, uint64_t pixels) {
+			paints_.Record(ns);
+			pixels_painted_ += pixels;
+		}
+		// One finished drag: the motion events it received and the
+		// geometry requests they turned into.
+		void RecordDrag(uint64_t motion_events, uint64_t requests) {
+			++drags_;
+			drag_motion_events_ += motion_events;
+			drag_requests_ += requests;
+		}
+		std::string Format(uint64_t events, uint64_t requests, uint64_t errors) const;
+
+	private:
+		LatencyHistogram& Histogram(int type) {
+			if (!by_type_[type]) {
+				by_type_[type].reset(new LatencyHistogram());
+			}
+			return *by_type_[type];
+		}
+
+		std::unique_ptr<LatencyHistogram> by_type_[EVENT_TYPES];
+		LatencyHistogram batches_;
+		LatencyHistogram tasks_[TASKS];
+		LatencyHistogram paints_;
+		uint64_t pixels_painted_;
+		uint64_t drags_;
+		uint64_t drag_motion_events_;
+		uint64_t drag_requests_;
+};
+
+// Records the time until the end of the scope as one run of a task.
+class TaskScope {
+	public:
+		TaskScope(Metrics& metrics, Metrics::Task task) :
+			metrics_(metrics), task_(task), start_(std::chrono::steady_clock::now()) {}
+		~TaskScope() {
+			metrics_.RecordTask(task_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start_).count());
+		}
+
+	private:
+		Metrics& metrics_;
+		const Metrics::Task task_;
+		const std::chrono::steady_clock::time_point start_;
+};
+
+// LIGHTWM_METRICS_SOCKET, or the control socket path with .metrics in
+// place of .sock.
+std::string DefaultMetricsSocketPath(const std::string& control_path);
+
+// Stream socket that writes one snapshot to every client that connects and
+// hangs up, e.g. "socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/lightwm_0.metrics".
+// Mode 0600, like the control socket.
+class MetricsServer {
+	public:
+		MetricsServer(EventLoop& loop, std::function<std::string()> snapshot);
+		~MetricsServer();
+		bool Open(const std::string& path);
+
+	private:
+		void Accept();
+
+		EventLoop& loop_;
+		std::function<std::string()> snapshot_;
+		int listen_fd_;
+		std::string path_;
+};
+#endif
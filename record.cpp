@@ -0,0 +1,351 @@
+#include "record.hpp"
+#include "trace.hpp"
+extern "C" {
+#include <X11/extensions/sync.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+static const size_t RECORD_BUFFER_SIZE = 1 << 20;
+
+EventRecord EncodeEventRecord(const XEvent& e, int sync_event_base) {
+    EventRecord r;
+    memset(&r, 0, sizeof(r));
+    r.serial = e.xany.serial;
+    r.type = e.type;
+    r.send_event = e.xany.send_event;
+    r.window = e.xany.window;
+    switch (e.type) {
+        case CreateNotify:
+            r.structure.subject = e.xcreatewindow.window;
+            r.structure.other = e.xcreatewindow.parent;
+            r.structure.x = e.xcreatewindow.x;
+            r.structure.y = e.xcreatewindow.y;
+            r.structure.width = e.xcreatewindow.width;
+            r.structure.height = e.xcreatewindow.height;
+            r.structure.border_width = e.xcreatewindow.border_width;
+            r.structure.flag = e.xcreatewindow.override_redirect;
+            break;
+        case DestroyNotify:
+            r.structure.subject = e.xdestroywindow.window;
+            r.structure.other = e.xdestroywindow.event;
+            break;
+        case MapNotify:
+            r.structure.subject = e.xmap.window;
+            r.structure.other = e.xmap.event;
+            r.structure.flag = e.xmap.override_redirect;
+            break;
+        case UnmapNotify:
+            r.structure.subject = e.xunmap.window;
+            r.structure.other = e.xunmap.event;
+            r.structure.flag = e.xunmap.from_configure;
+            break;
+        case ReparentNotify:
+            r.structure.subject = e.xreparent.window;
+            r.structure.other = e.xreparent.parent;
+            r.structure.x = e.xreparent.x;
+            r.structure.y = e.xreparent.y;
+            r.structure.flag = e.xreparent.override_redirect;
+            break;
+        case ConfigureNotify:
+            r.structure.subject = e.xconfigure.window;
+            r.structure.other = e.xconfigure.event;
+            r.structure.above = e.xconfigure.above;
+            r.structure.x = e.xconfigure.x;
+            r.structure.y = e.xconfigure.y;
+            r.structure.width = e.xconfigure.width;
+            r.structure.height = e.xconfigure.height;
+            r.structure.border_width = e.xconfigure.border_width;
+            r.structure.flag = e.xconfigure.override_redirect;
+            break;
+        case CirculateNotify:
+            r.structure.subject = e.xcirculate.window;
+            r.structure.other = e.xcirculate.event;
+            r.structure.detail = e.xcirculate.place;
+            break;
+        case MapRequest:
+            r.structure.subject = e.xmaprequest.window;
+            r.structure.other = e.xmaprequest.parent;
+            break;
+        case ConfigureRequest:
+            r.structure.subject = e.xconfigurerequest.window;
+            r.structure.other = e.xconfigurerequest.parent;
+            r.structure.above = e.xconfigurerequest.above;
+            r.structure.value_mask = e.xconfigurerequest.value_mask;
+            r.structure.x = e.xconfigurerequest.x;
+            r.structure.y = e.xconfigurerequest.y;
+            r.structure.width = e.xconfigurerequest.width;
+            r.structure.height = e.xconfigurerequest.height;
+            r.structure.border_width = e.xconfigurerequest.border_width;
+            r.structure.detail = e.xconfigurerequest.detail;
+            break;
+        /* XKeyEvent, XButtonEvent and XMotionEvent share their layout up to
+         * the detail field. */
+        case KeyPress:
+        case KeyRelease:
+        case ButtonPress:
+        case ButtonRelease:
+        case MotionNotify:
+            r.input.root = e.xbutton.root;
+            r.input.subwindow = e.xbutton.subwindow;
+            r.input.time = e.xbutton.time;
+            r.input.state = e.xbutton.state;
+            r.input.x = e.xbutton.x;
+            r.input.y = e.xbutton.y;
+            r.input.x_root = e.xbutton.x_root;
+            r.input.y_root = e.xbutton.y_root;
+            if (e.type == MotionNotify) {
+                r.input.is_hint = e.xmotion.is_hint;
+                r.input.same_screen = e.xmotion.same_screen;
+            } else if (e.type == KeyPress || e.type == KeyRelease) {
+                r.input.detail = e.xkey.keycode;
+                r.input.same_screen = e.xkey.same_screen;
+            } else {
+                r.input.detail = e.xbutton.button;
+                r.input.same_screen = e.xbutton.same_screen;
+            }
+            break;
+        case FocusIn:
+        case FocusOut:
+            r.focus.mode = e.xfocus.mode;
+            r.focus.detail = e.xfocus.detail;
+            break;
+        case PropertyNotify:
+            r.property.atom = e.xproperty.atom;
+            r.property.time = e.xproperty.time;
+            r.property.state = e.xproperty.state;
+            break;
+        case MappingNotify:
+            r.mapping.request = e.xmapping.request;
+            r.mapping.first_keycode = e.xmapping.first_keycode;
+            r.mapping.count = e.xmapping.count;
+            break;
+        default:
+            if (sync_event_base >= 0 && e.type == sync_event_base + XSyncAlarmNotify) {
+                const XSyncAlarmNotifyEvent& a = reinterpret_cast<const XSyncAlarmNotifyEvent&>(e);
+                r.alarm.alarm = a.alarm;
+                r.alarm.counter_value = (static_cast<int64_t>(XSyncValueHigh32(a.counter_value)) << 32) | XSyncValueLow32(a.counter_value);
+                r.alarm.alarm_value = (static_cast<int64_t>(XSyncValueHigh32(a.alarm_value)) << 32) | XSyncValueLow32(a.alarm_value);
+                r.alarm.time = a.time;
+                r.alarm.state = a.state;
+            }
+            break;
+    }
+    return r;
+}
+
+XEvent DecodeEventRecord(const EventRecord& r, int sync_event_base) {
+    XEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = r.type;
+    e.xany.serial = r.serial;
+    e.xany.send_event = r.send_event;
+    e.xany.window = r.window;
+    switch (r.type) {
+        case CreateNotify:
+            e.xcreatewindow.window = r.structure.subject;
+            e.xcreatewindow.parent = r.structure.other;
+            e.xcreatewindow.x = r.structure.x;
+            e.xcreatewindow.y = r.structure.y;
+            e.xcreatewindow.width = r.structure.width;
+            e.xcreatewindow.height = r.structure.height;
+            e.xcreatewindow.border_width = r.structure.border_width;
+            e.xcreatewindow.override_redirect = r.structure.flag;
+            break;
+        case DestroyNotify:
+            e.xdestroywindow.window = r.structure.subject;
+            e.xdestroywindow.event = r.structure.other;
+            break;
+        case MapNotify:
+            e.xmap.window = r.structure.subject;
+            e.xmap.event = r.structure.other;
+            e.xmap.override_redirect = r.structure.flag;
+            break;
+        case UnmapNotify:
+            e.xunmap.window = r.structure.subject;
+            e.xunmap.event = r.structure.other;
+            e.xunmap.from_configure = r.structure.flag;
+            break;
+        case ReparentNotify:
+            e.xreparent.window = r.structure.subject;
+            e.xreparent.parent = r.structure.other;
+            e.xreparent.x = r.structure.x;
+            e.xreparent.y = r.structure.y;
+            e.xreparent.override_redirect = r.structure.flag;
+            break;
+        case ConfigureNotify:
+            e.xconfigure.window = r.structure.subject;
+            e.xconfigure.event = r.structure.other;
+            e.xconfigure.above = r.structure.above;
+            e.xconfigure.x = r.structure.x;
+            e.xconfigure.y = r.structure.y;
+            e.xconfigure.width = r.structure.width;
+            e.xconfigure.height = r.structure.height;
+            e.xconfigure.border_width = r.structure.border_width;
+            e.xconfigure.override_redirect = r.structure.flag;
+            break;
+        case CirculateNotify:
+            e.xcirculate.window = r.structure.subject;
+            e.xcirculate.event = r.structure.other;
+            e.xcirculate.place = r.structure.detail;
+            break;
+        case MapRequest:
+            e.xmaprequest.window = r.structure.subject;
+            e.xmaprequest.parent = r.structure.other;
+            break;
+        case ConfigureRequest:
+            e.xconfigurerequest.window = r.structure.subject;
+            e.xconfigurerequest.parent = r.structure.other;
+            e.xconfigurerequest.above = r.structure.above;
+            e.xconfigurerequest.value_mask = r.structure.value_mask;
+            e.xconfigurerequest.x = r.structure.x;
+            e.xconfigurerequest.y = r.structure.y;
+            e.xconfigurerequest.width = r.structure.width;
+            e.xconfigurerequest.height = r.structure.height;
+            e.xconfigurerequest.border_width = r.structure.border_width;
+            e.xconfigurerequest.detail = r.structure.detail;
+            break;
+        case KeyPress:
+        case KeyRelease:
+        case ButtonPress:
+        case ButtonRelease:
+        case MotionNotify:
+            e.xbutton.root = r.input.root;
+            e.xbutton.subwindow = r.input.subwindow;
+            e.xbutton.time = r.input.time;
+            e.xbutton.state = r.input.state;
+            e.xbutton.x = r.input.x;
+            e.xbutton.y = r.input.y;
+            e.xbutton.x_root = r.input.x_root;
+            e.xbutton.y_root = r.input.y_root;
+            if (r.type == MotionNotify) {
+                e.xmotion.is_hint = r.input.is_hint;
+                e.xmotion.same_screen = r.input.same_screen;
+            } else if (r.type == KeyPress || r.type == KeyRelease) {
+                e.xkey.keycode = r.input.detail;
+                e.xkey.same_screen = r.input.same_screen;
+            } else {
+                e.xbutton.button = r.input.detail;
+                e.xbutton.same_screen = r.input.same_screen;
+            }
+            break;
+        case FocusIn:
+        case FocusOut:
+            e.xfocus.mode = r.focus.mode;
+            e.xfocus.detail = r.focus.detail;
+            break;
+        case PropertyNotify:
+            e.xproperty.atom = r.property.atom;
+            e.xproperty.time = r.property.time;
+            e.xproperty.state = r.property.state;
+            break;
+        case MappingNotify:
+            e.xmapping.request = r.mapping.request;
+            e.xmapping.first_keycode = r.mapping.first_keycode;
+            e.xmapping.count = r.mapping.count;
+            break;
+        default:
+            if (sync_event_base >= 0 && r.type == sync_event_base + XSyncAlarmNotify) {
+                XSyncAlarmNotifyEvent& a = reinterpret_cast<XSyncAlarmNotifyEvent&>(e);
+                a.alarm = r.alarm.alarm;
+                XSyncIntsToValue(&a.counter_value, r.alarm.counter_value & 0xffffffff, r.alarm.counter_value >> 32);
+                XSyncIntsToValue(&a.alarm_value, r.alarm.alarm_value & 0xffffffff, r.alarm.alarm_value >> 32);
+                a.time = r.alarm.time;
+                a.state = static_cast<XSyncAlarmState>(r.alarm.state);
+            }
+            break;
+    }
+    return e;
+}
+
+EventRecorder::EventRecorder() : file_(nullptr), sync_event_base_(-1), records_(0) {}
+
+EventRecorder::~EventRecorder() {
+    Stop();
+}
+
+bool EventRecorder::Start(const string& path, int sync_event_base) {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, RECORD_BUFFER_SIZE);
+    sync_event_base_ = sync_event_base;
+    EventRecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENT_RECORDING_MAGIC, sizeof(header.magic));
+    header.version = EVENT_RECORDING_VERSION;
+    header.record_size = sizeof(EventRecord);
+    header.sync_event_base = sync_event_base;
+    fwrite(&header, sizeof(header), 1, file_);
+    return true;
+}
+
+void EventRecorder::Stop() {
+    if (file_ == nullptr) {
+        return;
+    }
+    fclose(file_);
+    file_ = nullptr;
+    cerr << "Recorded " << records_ << " events" << endl;
+}
+
+void EventRecorder::Record(const XEvent& event, uint8_t flags) {
+    EventRecord record = EncodeEventRecord(event, sync_event_base_);
+    record.timestamp_ns = TraceNow();
+    record.flags = flags;
+    fwrite(&record, sizeof(record), 1, file_);
+    ++records_;
+}
+
+EventRecording::EventRecording() :
+    map_(MAP_FAILED),
+    length_(0),
+    header_(nullptr),
+    records_(nullptr),
+    count_(0) {
+}
+
+EventRecording::~EventRecording() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, length_);
+    }
+}
+
+bool EventRecording::Open(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        cerr << "Failed to open " << path << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(EventRecordingHeader)) {
+        cerr << path << " is not an event recording" << endl;
+        close(fd);
+        return false;
+    }
+    length_ = st.st_size;
+    map_ = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_ == MAP_FAILED) {
+        cerr << "Failed to map " << path << endl;
+        return false;
+    }
+    header_ = static_cast<const EventRecordingHeader*>(map_);
+    if (memcmp(header_->magic, EVENT_RECORDING_MAGIC, sizeof(header_->magic)) != 0 ||
+        header_->version != EVENT_RECORDING_VERSION ||
+        header_->record_size != sizeof(EventRecord)) {
+        cerr << path << " is not an event recording of this version" << endl;
+        return false;
+    }
+    madvise(map_, length_, MADV_SEQUENTIAL);
+    records_ = reinterpret_cast<const EventRecord*>(static_cast<const char*>(map_) + sizeof(EventRecordingHeader));
+    /* A recording cut short by a crash ends with a partial record. */
+    count_ = (length_ - sizeof(EventRecordingHeader)) / sizeof(EventRecord);
+    return true;
+}
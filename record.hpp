@@ -0,0 +1,125 @@
+#ifndef RECORD_HPP
+#define RECORD_HPP
+#include <cstdint>
+#include <cstdio>
+#include <string>
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+// Event recordings (LIGHTWM_RECORD). Unlike the trace, which keeps only
+// what ToString(const XEvent&) prints, a recording holds every field of the
+// protocol event that the handlers can read, so it can be fed back into
+// them. The file is a header followed by a flat array of fixed-size
+// records, so a replay maps it and walks the array without parsing.
+#define EVENT_RECORDING_MAGIC "LWMEVREC"
+#define EVENT_RECORDING_VERSION 2
+
+struct EventRecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    // First event number of the SYNC extension on the recording server, so
+    // alarm events can be renumbered for the server they are replayed on.
+    int32_t sync_event_base;
+    uint32_t reserved;
+};
+
+// The event was taken off the queue by motion coalescing and replaced the
+// event recorded before it, which was never dispatched as read.
+#define EVENT_RECORD_COALESCED 0x01
+
+// One event in 64 bytes, in the sizes the protocol uses. Which member of
+// the union holds it depends on type; types the WM does not handle keep
+// only the header.
+struct EventRecord {
+    uint64_t timestamp_ns;  // monotonic clock when the event was read
+    uint32_t serial;        // low 32 bits, enough to tell requests apart
+    uint16_t type;
+    uint8_t flags;          // EVENT_RECORD_* bits
+    uint8_t send_event;
+    uint32_t window;        // xany.window
+    union {
+        // Create, Destroy, Map, Unmap, Reparent, Configure, Circulate,
+        // MapRequest and ConfigureRequest.
+        struct {
+            uint32_t subject;       // the window it is about
+            uint32_t other;         // parent or event window
+            uint32_t above;
+            uint32_t value_mask;
+            int16_t x, y;
+            uint16_t width, height, border_width;
+            uint8_t detail;         // stack mode or circulate place
+            uint8_t flag;           // override_redirect or from_configure
+        } structure;
+        // Key, button and motion.
+        struct {
+            uint32_t root, subwindow;
+            uint32_t time;
+            uint32_t state;
+            uint32_t detail;        // keycode or button
+            int16_t x, y, x_root, y_root;
+            uint8_t same_screen;
+            uint8_t is_hint;
+        } input;
+        struct {
+            uint8_t mode, detail;
+        } focus;
+        struct {
+            uint32_t atom, time;
+            uint8_t state;
+        } property;
+        struct {
+            uint8_t request, first_keycode, count;
+        } mapping;
+        struct {
+            int64_t counter_value, alarm_value;
+            uint32_t alarm, time;
+            uint8_t state;
+        } alarm;
+        uint8_t padding[40];
+    };
+};
+static_assert(sizeof(EventRecord) == 64, "EventRecord must stay one cache line");
+
+// sync_event_base: first SYNC event number, -1 without the extension.
+EventRecord EncodeEventRecord(const XEvent& event, int sync_event_base);
+XEvent DecodeEventRecord(const EventRecord& record, int sync_event_base);
+
+// Appends events to a recording. Writes go through a large stdio buffer on
+// the event loop's thread; a record is a single memcpy into it.
+class EventRecorder {
+    public:
+        EventRecorder();
+        ~EventRecorder();
+        bool Start(const std::string& path, int sync_event_base);
+        void Stop();
+        bool active() const { return file_ != nullptr; }
+        // flags: EVENT_RECORD_* bits.
+        void Record(const XEvent& event, uint8_t flags = 0);
+
+    private:
+        FILE* file_;
+        int sync_event_base_;
+        uint64_t records_;
+};
+
+// A recording mapped read-only into memory.
+class EventRecording {
+    public:
+        EventRecording();
+        ~EventRecording();
+        bool Open(const std::string& path);
+        const EventRecordingHeader& header() const { return *header_; }
+        const EventRecord* begin() const { return records_; }
+        const EventRecord* end() const { return records_ + count_; }
+        size_t size() const { return count_; }
+
+    private:
+        void* map_;
+        size_t length_;
+        const EventRecordingHeader* header_;
+        const EventRecord* records_;
+        size_t count_;
+};
+#endif
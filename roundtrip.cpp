@@ -0,0 +1,160 @@
+#include "roundtrip.hpp"
+#include <bitset>
+#include <sstream>
+using namespace std;
+
+AuditingConnection::AuditingConnection(unique_ptr<XConnection> inner) :
+    inner_(move(inner)),
+    context_("startup"),
+    keyboard_mapping_loaded_(false) {
+}
+
+AuditingConnection::Blocked::~Blocked() {
+    if (count_ == 0) {
+        return;
+    }
+    Stats& stats = audit_.report_[audit_.context_][request_];
+    stats.count += count_;
+    stats.blocked += chrono::steady_clock::now() - start_;
+}
+
+unsigned long AuditingConnection::RoundTrips(const string& context) const {
+    const auto i = report_.find(context);
+    if (i == report_.end()) {
+        return 0;
+    }
+    unsigned long count = 0;
+    for (const auto& request : i->second) {
+        count += request.second.count;
+    }
+    return count;
+}
+
+string AuditingConnection::Format() const {
+    ostringstream out;
+    for (const auto& handler : report_) {
+        for (const auto& request : handler.second) {
+            out << "{\"handler\": \"" << handler.first << "\", \"request\": \"" << request.first
+                << "\", \"count\": " << request.second.count
+                << ", \"blocked_us\": " << chrono::duration_cast<chrono::microseconds>(request.second.blocked).count() << "}\n";
+        }
+    }
+    return out.str();
+}
+
+void AuditingConnection::Sync() {
+    Blocked blocked(*this, "Sync");
+    inner_->Sync();
+}
+
+/* Without pipelining, XGetWindowAttributes (GetWindowAttributes and then
+ * GetGeometry) for every window and each cached property of the windows
+ * that still exist. */
+vector<WindowInfo> AuditingConnection::FetchWindowInfo(const vector<Window>& windows, const AtomRegistry& atoms) {
+    Blocked blocked(*this, "FetchWindowInfo", !windows.empty());
+    vector<WindowInfo> infos = inner_->FetchWindowInfo(windows, atoms);
+    if (!inner_->pipelined()) {
+        unsigned long waits = 0;
+        for (const WindowInfo& info : infos) {
+            waits += 2 + (info.valid ? bitset<32>(ALL_PROPERTIES).count() : 0);
+        }
+        blocked.set_count(waits);
+    }
+    return infos;
+}
+
+/* Without pipelining, one GetProperty per property asked for. */
+void AuditingConnection::FetchProperties(const vector<PropertyFetch>& fetches, const AtomRegistry& atoms) {
+    unsigned long waits = 0;
+    for (const PropertyFetch& fetch : fetches) {
+        waits += bitset<32>(fetch.properties & ALL_PROPERTIES).count();
+    }
+    if (inner_->pipelined()) {
+        waits = waits != 0;
+    }
+    Blocked blocked(*this, "FetchProperties", waits);
+    inner_->FetchProperties(fetches, atoms);
+}
+
+bool AuditingConnection::QueryChildren(Window w, vector<Window>* children) {
+    Blocked blocked(*this, "QueryChildren");
+    return inner_->QueryChildren(w, children);
+}
+
+vector<Atom> AuditingConnection::InternAtoms(const vector<string>& names) {
+    Blocked blocked(*this, "InternAtoms");
+    return inner_->InternAtoms(names);
+}
+
+/* XGetWindowAttributes waits for GetWindowAttributes and GetGeometry. */
+bool AuditingConnection::GetWindowAttributes(Window w, XWindowAttributes* attributes) {
+    Blocked blocked(*this, "GetWindowAttributes", 2);
+    return inner_->GetWindowAttributes(w, attributes);
+}
+
+bool AuditingConnection::GetCardinalProperty(Window w, Atom property, unsigned long* value) {
+    Blocked blocked(*this, "GetCardinalProperty");
+    return inner_->GetCardinalProperty(w, property, value);
+}
+
+bool AuditingConnection::GrabKeyboard() {
+    Blocked blocked(*this, "GrabKeyboard");
+    return inner_->GrabKeyboard();
+}
+
+/* The lookup that finds the mapping missing is the one that waits for it:
+ * GetKeyboardMapping, or the XKB map when XKB is on. */
+unsigned long AuditingConnection::KeyboardMappingWaits() {
+    const bool loaded = keyboard_mapping_loaded_;
+    keyboard_mapping_loaded_ = true;
+    return loaded ? 0 : 1;
+}
+
+KeyCode AuditingConnection::KeysymToKeycode(KeySym keysym) {
+    Blocked blocked(*this, "GetKeyboardMapping", KeyboardMappingWaits());
+    return inner_->KeysymToKeycode(keysym);
+}
+
+KeySym AuditingConnection::KeycodeToKeysym(KeyCode keycode) {
+    Blocked blocked(*this, "GetKeyboardMapping", KeyboardMappingWaits());
+    return inner_->KeycodeToKeysym(keycode);
+}
+
+void AuditingConnection::RefreshKeyboardMapping(XMappingEvent* event) {
+    if (event->request != MappingPointer) {
+        keyboard_mapping_loaded_ = false;
+    }
+    inner_->RefreshKeyboardMapping(event);
+}
+
+bool AuditingConnection::QuerySync(int* event_base) {
+    Blocked blocked(*this, "QuerySync");
+    return inner_->QuerySync(event_base);
+}
+
+bool AuditingConnection::QueryCounter(XSyncCounter counter, int64_t* value) {
+    Blocked blocked(*this, "QueryCounter");
+    return inner_->QueryCounter(counter, value);
+}
+
+RoundTripScope::RoundTripScope(AuditingConnection* audit, const char* context) :
+    audit_(audit) {
+    if (audit_ != nullptr) {
+        previous_ = audit_->context();
+        audit_->SetContext(context);
+    }
+}
+
+RoundTripScope::RoundTripScope(AuditingConnection* audit, int event_type) :
+    audit_(audit) {
+    if (audit_ != nullptr) {
+        previous_ = audit_->context();
+        audit_->SetContext("On" + EventTypeName(event_type));
+    }
+}
+
+RoundTripScope::~RoundTripScope() {
+    if (audit_ != nullptr) {
+        audit_->SetContext(previous_);
+    }
+}
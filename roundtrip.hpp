@@ -0,0 +1,154 @@
+#ifndef ROUNDTRIP_HPP
+#define ROUNDTRIP_HPP
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include "xconnection.hpp"
+
+// Wraps another connection and counts every time it waits for the server's
+// answer (Sync and the queries), with the wall time spent blocked, under
+// the handler that was running at the time. Everything else is passed
+// straight through. A batched query such as FetchWindowInfo counts once
+// where the backend pipelines it (XCB); the Xlib backend waits once per
+// query, e.g. 1 + 7 times per window for FetchWindowInfo.
+//
+// LIGHTWM_AUDIT_ROUND_TRIPS=1 puts one in front of the real server; the
+// report goes to stderr on SIGUSR1 and on exit, and the roundtrips control
+// command returns the same numbers.
+class AuditingConnection : public XConnection {
+	public:
+		struct Stats {
+			unsigned long count = 0;
+			std::chrono::nanoseconds blocked{0};
+		};
+		// Handler name, then request name.
+		typedef std::map<std::string, std::map<std::string, Stats>> Report;
+
+		explicit AuditingConnection(std::unique_ptr<XConnection> inner);
+
+		// What round trips are charged to from now on; see RoundTripScope.
+		const std::string& context() const { return context_; }
+		void SetContext(const std::string& context) { context_ = context; }
+		const Report& report() const { return report_; }
+		// Round trips made so far by one handler, for checks like "motion
+		// never waits on the server".
+		unsigned long RoundTrips(const std::string& context) const;
+		// One JSON object per handler and request.
+		std::string Format() const;
+		void Reset() { report_.clear(); }
+
+		Display* display() override { return inner_->display(); }
+		std::string name() const override { return inner_->name(); }
+		Window root() const override { return inner_->root(); }
+		Size<int> screen_size() const override { return inner_->screen_size(); }
+		int fd() const override { return inner_->fd(); }
+		unsigned long NextRequestSerial() override { return inner_->NextRequestSerial(); }
+		void Flush() override { inner_->Flush(); }
+		void Sync() override;
+		bool pipelined() const override { return inner_->pipelined(); }
+
+		int Pending() override { return inner_->Pending(); }
+		void NextEvent(XEvent* event) override { inner_->NextEvent(event); }
+		bool CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) override {
+			return inner_->CheckIfEvent(event, predicate, arg);
+		}
+		int QueuedEvents() override { return inner_->QueuedEvents(); }
+
+		Window CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+		                    unsigned int border_width, unsigned long border, unsigned long background) override {
+			return inner_->CreateWindow(parent, x, y, width, height, border_width, border, background);
+		}
+		void DestroyWindow(Window w) override { inner_->DestroyWindow(w); }
+		void MapWindow(Window w) override { inner_->MapWindow(w); }
+		void UnmapWindow(Window w) override { inner_->UnmapWindow(w); }
+		void ReparentWindow(Window w, Window parent, int x, int y) override { inner_->ReparentWindow(w, parent, x, y); }
+		void ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) override {
+			inner_->ConfigureWindow(w, value_mask, changes);
+		}
+		void MoveWindow(Window w, int x, int y) override { inner_->MoveWindow(w, x, y); }
+		void ResizeWindow(Window w, unsigned int width, unsigned int height) override { inner_->ResizeWindow(w, width, height); }
+		void MoveResizeWindow(Window w, int x, int y, unsigned int width, unsigned int height) override {
+			inner_->MoveResizeWindow(w, x, y, width, height);
+		}
+		void RaiseWindow(Window w) override { inner_->RaiseWindow(w); }
+		void SelectInput(Window w, long event_mask) override { inner_->SelectInput(w, event_mask); }
+		void AddToSaveSet(Window w) override { inner_->AddToSaveSet(w); }
+		void RemoveFromSaveSet(Window w) override { inner_->RemoveFromSaveSet(w); }
+		void SetInputFocus(Window w) override { inner_->SetInputFocus(w); }
+		bool SendEvent(Window w, const XEvent& event) override { return inner_->SendEvent(w, event); }
+		void KillClient(Window w) override { inner_->KillClient(w); }
+		void ChangeProperty(Window w, Atom property, Atom type, int format, int mode, const void* data, int count) override {
+			inner_->ChangeProperty(w, property, type, format, mode, data, count);
+		}
+
+		std::vector<WindowInfo> FetchWindowInfo(const std::vector<Window>& windows, const AtomRegistry& atoms) override;
+		void FetchProperties(const std::vector<PropertyFetch>& fetches, const AtomRegistry& atoms) override;
+		bool QueryChildren(Window w, std::vector<Window>* children) override;
+		std::vector<Atom> InternAtoms(const std::vector<std::string>& names) override;
+		bool GetWindowAttributes(Window w, XWindowAttributes* attributes) override;
+		bool GetCardinalProperty(Window w, Atom property, unsigned long* value) override;
+
+		void GrabServer() override { inner_->GrabServer(); }
+		void UngrabServer() override { inner_->UngrabServer(); }
+		bool GrabKeyboard() override;
+		void UngrabKeyboard() override { inner_->UngrabKeyboard(); }
+		void GrabKey(KeyCode keycode, unsigned int modifiers) override { inner_->GrabKey(keycode, modifiers); }
+		void UngrabAllKeys() override { inner_->UngrabAllKeys(); }
+		void GrabButton(unsigned int button, unsigned int modifiers, unsigned int event_mask) override {
+			inner_->GrabButton(button, modifiers, event_mask);
+		}
+
+		// Answered from Xlib's copy of the keyboard mapping, which the first
+		// lookup after startup or a refresh fetches from the server.
+		KeyCode KeysymToKeycode(KeySym keysym) override;
+		KeySym KeycodeToKeysym(KeyCode keycode) override;
+		void RefreshKeyboardMapping(XMappingEvent* event) override;
+
+		void DrawOutline(int x, int y, unsigned int width, unsigned int height) override { inner_->DrawOutline(x, y, width, height); }
+
+		bool QuerySync(int* event_base) override;
+		bool QueryCounter(XSyncCounter counter, int64_t* value) override;
+		XSyncAlarm CreateAlarm(XSyncCounter counter, int64_t value) override { return inner_->CreateAlarm(counter, value); }
+		void ChangeAlarm(XSyncAlarm alarm, int64_t value) override { inner_->ChangeAlarm(alarm, value); }
+		void DestroyAlarm(XSyncAlarm alarm) override { inner_->DestroyAlarm(alarm); }
+
+	private:
+		// Times one blocking request from construction to destruction.
+		class Blocked {
+			public:
+				// count: the replies waited for one after the other.
+				Blocked(AuditingConnection& audit, const char* request, unsigned long count = 1) :
+					audit_(audit), request_(request), count_(count), start_(std::chrono::steady_clock::now()) {}
+				~Blocked();
+				// For calls whose waits depend on what the server answered.
+				void set_count(unsigned long count) { count_ = count; }
+			private:
+				AuditingConnection& audit_;
+				const char* request_;
+				unsigned long count_;
+				std::chrono::steady_clock::time_point start_;
+		};
+		// 1 the first time after startup or a refresh, else 0.
+		unsigned long KeyboardMappingWaits();
+
+		std::unique_ptr<XConnection> inner_;
+		std::string context_;
+		Report report_;
+		bool keyboard_mapping_loaded_;
+};
+
+// Charges round trips to context until the end of the scope, then puts the
+// previous context back. Does nothing without an audit.
+class RoundTripScope {
+	public:
+		RoundTripScope(AuditingConnection* audit, const char* context);
+		// The handler for an event of this type, "On" + its name.
+		RoundTripScope(AuditingConnection* audit, int event_type);
+		~RoundTripScope();
+
+	private:
+		AuditingConnection* audit_;
+		std::string previous_;
+};
+#endif
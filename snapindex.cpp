@@ -0,0 +1,88 @@
+#include "snapindex.hpp"
+#include <cstdlib>
+#include <climits>
+using namespace std;
+
+SnapIndex::SnapIndex() :
+    screen_{0, 0, 0, 0} {
+}
+
+void SnapIndex::SetScreen(const Rect& screen) {
+    screen_ = screen;
+}
+
+void SnapIndex::Update(Window window, const Rect& rect) {
+    const auto i = rects_.find(window);
+    if (i != rects_.end()) {
+        if (i->second == rect) {
+            return;
+        }
+        Erase(vertical_, i->second.x, i->second.x + i->second.width, window);
+        Erase(horizontal_, i->second.y, i->second.y + i->second.height, window);
+    }
+    rects_[window] = rect;
+    Insert(vertical_, rect.x, rect.x + rect.width, window, rect.y, rect.y + rect.height);
+    Insert(horizontal_, rect.y, rect.y + rect.height, window, rect.x, rect.x + rect.width);
+}
+
+void SnapIndex::Remove(Window window) {
+    const auto i = rects_.find(window);
+    if (i == rects_.end()) {
+        return;
+    }
+    Erase(vertical_, i->second.x, i->second.x + i->second.width, window);
+    Erase(horizontal_, i->second.y, i->second.y + i->second.height, window);
+    rects_.erase(i);
+}
+
+Position<int> SnapIndex::Snap(Window moving, const Rect& rect, int distance) const {
+    if (distance <= 0) {
+        return Position<int>(rect.x, rect.y);
+    }
+    const int right = rect.x + rect.width;
+    const int bottom = rect.y + rect.height;
+    /* The smallest correction found so far on each axis; INT_MAX for none. */
+    int dx = INT_MAX;
+    int dy = INT_MAX;
+    for (int edge : {screen_.x, screen_.x + screen_.width}) {
+        for (int delta : {edge - rect.x, edge - right}) {
+            if (abs(delta) <= distance && abs(delta) < abs(dx)) {
+                dx = delta;
+            }
+        }
+    }
+    for (int edge : {screen_.y, screen_.y + screen_.height}) {
+        for (int delta : {edge - rect.y, edge - bottom}) {
+            if (abs(delta) <= distance && abs(delta) < abs(dy)) {
+                dy = delta;
+            }
+        }
+    }
+    Nearest(vertical_, moving, rect.x, rect.y, bottom, distance, &dx);
+    Nearest(vertical_, moving, right, rect.y, bottom, distance, &dx);
+    Nearest(horizontal_, moving, rect.y, rect.x, right, distance, &dy);
+    Nearest(horizontal_, moving, bottom, rect.x, right, distance, &dy);
+    return Position<int>(rect.x + (dx == INT_MAX ? 0 : dx), rect.y + (dy == INT_MAX ? 0 : dy));
+}
+
+void SnapIndex::Insert(Edges& edges, int near, int far, Window window, int start, int end) {
+    edges.insert(Edge{near, window, start, end});
+    edges.insert(Edge{far, window, start, end});
+}
+
+void SnapIndex::Erase(Edges& edges, int near, int far, Window window) {
+    edges.erase(Edge{near, window, 0, 0});
+    edges.erase(Edge{far, window, 0, 0});
+}
+
+/* Looks at the edges within distance of edge and keeps the closest one
+ * whose frame overlaps [span_start, span_end) on the other axis, i.e. one
+ * the moving rectangle would actually line up against. */
+void SnapIndex::Nearest(const Edges& edges, Window moving, int edge, int span_start, int span_end, int distance, int* best) {
+    for (auto i = edges.lower_bound(Edge{edge - distance, 0, 0, 0}); i != edges.end() && i->position <= edge + distance; ++i) {
+        const int delta = i->position - edge;
+        if (i->window != moving && abs(delta) < abs(*best) && i->start < span_end && span_start < i->end) {
+            *best = delta;
+        }
+    }
+}
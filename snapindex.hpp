@@ -0,0 +1,52 @@
+#ifndef SNAPINDEX_HPP
+#define SNAPINDEX_HPP
+#include <set>
+#include <unordered_map>
+#include "eventnames.hpp"
+#include "layout.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+// Frame rectangles indexed by their edges for magnetic snapping. Vertical
+// edges (left and right) and horizontal edges (top and bottom) each sit in
+// a set ordered by coordinate, so a snap query is a range lookup around
+// the moving rectangle's edges: O(log n) plus the edges that fall inside
+// the snap distance. Updating a frame replaces its four entries.
+class SnapIndex {
+	public:
+		SnapIndex();
+		// Screen edges snap like the edges of a frame that spans the screen.
+		void SetScreen(const Rect& screen);
+		// Inserts window, or moves it to rect. rect is the outer rectangle,
+		// borders included.
+		void Update(Window window, const Rect& rect);
+		void Remove(Window window);
+		bool Contains(Window window) const { return rects_.count(window) != 0; }
+		size_t size() const { return rects_.size(); }
+		// Where a rectangle moved to rect's position should go: each axis is
+		// pulled to the nearest edge within distance that it lies alongside.
+		// moving itself is ignored.
+		Position<int> Snap(Window moving, const Rect& rect, int distance) const;
+
+	private:
+		// One edge at position, of a frame spanning [start, end) on the
+		// other axis. The span is kept inline so queries never look up the
+		// frame's rectangle.
+		struct Edge {
+			int position;
+			Window window;
+			int start, end;
+			bool operator<(const Edge& o) const { return position != o.position ? position < o.position : window < o.window; }
+		};
+		typedef std::set<Edge> Edges;
+		static void Insert(Edges& edges, int near, int far, Window window, int start, int end);
+		static void Erase(Edges& edges, int near, int far, Window window);
+		static void Nearest(const Edges& edges, Window moving, int edge, int span_start, int span_end, int distance, int* best);
+
+		Edges vertical_;
+		Edges horizontal_;
+		std::unordered_map<Window, Rect> rects_;
+		Rect screen_;
+};
+#endif
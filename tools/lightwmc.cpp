@@ -0,0 +1,77 @@
+// Command line client for the LightWM control socket.
+//
+//   lightwmc [-s socket] <command> [args] [\; <command> [args]]...
+//   lightwmc [-s socket] -          (one command per line from stdin)
+//
+// All commands go to the WM in a single message and are applied as one
+// batch; the reply has one line per command.
+#include <cstring>
+#include <iostream>
+#include <string>
+extern "C" {
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+#include "../control.hpp"
+using namespace std;
+
+int main(int argc, char** argv) {
+    string path = DefaultControlSocketPath(nullptr);
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        path = argv[2];
+        first = 3;
+    }
+    if (first >= argc) {
+        cerr << "usage: " << argv[0] << " [-s socket] <command> [args] [\\; <command> [args]]... | -" << endl;
+        return 2;
+    }
+    string request;
+    if (strcmp(argv[first], "-") == 0) {
+        string line;
+        while (getline(cin, line)) {
+            request += line + "\n";
+        }
+    } else {
+        for (int i = first; i < argc; ++i) {
+            if (strcmp(argv[i], ";") == 0) {
+                request += "\n";
+            } else {
+                if (!request.empty() && request.back() != '\n') {
+                    request += " ";
+                }
+                request += argv[i];
+            }
+        }
+        request += "\n";
+    }
+    if (request.size() > CONTROL_MAX_MESSAGE) {
+        cerr << "Request too large" << endl;
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        cerr << "Failed to connect to " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (send(fd, request.data(), request.size(), 0) < 0) {
+        cerr << "Failed to send request: " << strerror(errno) << endl;
+        return 1;
+    }
+    static char reply[CONTROL_MAX_MESSAGE];
+    const ssize_t length = recv(fd, reply, sizeof(reply), 0);
+    close(fd);
+    if (length < 0) {
+        cerr << "Failed to read reply: " << strerror(errno) << endl;
+        return 1;
+    }
+    cout.write(reply, length);
+    /* Non-zero exit if any command in the batch failed. */
+    return string(reply, length).find("error") == string::npos ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+// Decodes a binary trace written by the event loop back into the text lines
+// the WM used to print for every event.
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "../eventnames.hpp"
+#include "../trace.hpp"
+using namespace std;
+
+int main(int argc, char** argv) {
+    bool timing = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0) {
+            timing = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr) {
+        cerr << "usage: " << argv[0] << " [-t] <trace file>" << endl;
+        return 1;
+    }
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        cerr << "Failed to open " << path << endl;
+        return 1;
+    }
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_FILE_VERSION ||
+        header.record_size != sizeof(TraceRecord)) {
+        cerr << path << " is not a LightWM trace of this version" << endl;
+        fclose(file);
+        return 1;
+    }
+    TraceRecord r;
+    uint64_t first_ns = 0;
+    bool first = true;
+    while (fread(&r, sizeof(r), 1, file) == 1) {
+        if (first) {
+            first_ns = r.timestamp_ns;
+            first = false;
+        }
+        if (timing) {
+            cout << "[" << (r.timestamp_ns - first_ns) / 1000 << "us +"
+                 << r.duration_ns / 1000 << "us #" << r.serial << "] ";
+        }
+        cout << "Event: \"" << ToString(DecodeTraceRecord(r)) << "\" occurred.\n";
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "trace.hpp"
+#include <cstring>
+using namespace std;
+
+TraceRecord EncodeTraceRecord(const XEvent& e) {
+    TraceRecord r;
+    memset(&r, 0, sizeof(r));
+    r.type = e.type;
+    r.serial = e.xany.serial;
+    r.window = e.xany.window;
+    switch (e.type) {
+        case CreateNotify:
+            r.window = e.xcreatewindow.window;
+            r.aux_window = e.xcreatewindow.parent;
+            r.x = e.xcreatewindow.x;
+            r.y = e.xcreatewindow.y;
+            r.width = e.xcreatewindow.width;
+            r.height = e.xcreatewindow.height;
+            r.detail = e.xcreatewindow.border_width;
+            r.flags = e.xcreatewindow.override_redirect ? TRACE_FLAG_OVERRIDE_REDIRECT : 0;
+            break;
+        case DestroyNotify:
+            r.window = e.xdestroywindow.window;
+            r.aux_window = e.xdestroywindow.event;
+            break;
+        case MotionNotify:
+            r.x = e.xmotion.x_root;
+            r.y = e.xmotion.y_root;
+            r.state = e.xmotion.state;
+            r.time = e.xmotion.time;
+            break;
+        case MapNotify:
+            r.window = e.xmap.window;
+            r.aux_window = e.xmap.event;
+            r.flags = e.xmap.override_redirect ? TRACE_FLAG_OVERRIDE_REDIRECT : 0;
+            break;
+        case UnmapNotify:
+            r.window = e.xunmap.window;
+            r.aux_window = e.xunmap.event;
+            r.flags = e.xunmap.from_configure ? TRACE_FLAG_FROM_CONFIGURE : 0;
+            break;
+        case ConfigureNotify:
+            r.window = e.xconfigure.window;
+            r.aux_window = e.xconfigure.event;
+            r.x = e.xconfigure.x;
+            r.y = e.xconfigure.y;
+            r.width = e.xconfigure.width;
+            r.height = e.xconfigure.height;
+            r.detail = e.xconfigure.border_width;
+            r.flags = e.xconfigure.override_redirect ? TRACE_FLAG_OVERRIDE_REDIRECT : 0;
+            break;
+        case ReparentNotify:
+            r.window = e.xreparent.window;
+            r.aux_window = e.xreparent.parent;
+            r.x = e.xreparent.x;
+            r.y = e.xreparent.y;
+            r.flags = e.xreparent.override_redirect ? TRACE_FLAG_OVERRIDE_REDIRECT : 0;
+            break;
+        case MapRequest:
+            r.window = e.xmaprequest.window;
+            r.aux_window = e.xmaprequest.parent;
+            break;
+        case ConfigureRequest:
+            r.window = e.xconfigurerequest.window;
+            r.aux_window = e.xconfigurerequest.parent;
+            r.x = e.xconfigurerequest.x;
+            r.y = e.xconfigurerequest.y;
+            r.width = e.xconfigurerequest.width;
+            r.height = e.xconfigurerequest.height;
+            r.detail = e.xconfigurerequest.border_width;
+            r.state = e.xconfigurerequest.value_mask;
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            r.x = e.xbutton.x_root;
+            r.y = e.xbutton.y_root;
+            r.detail = e.xbutton.button;
+            r.state = e.xbutton.state;
+            r.time = e.xbutton.time;
+            break;
+        case KeyPress:
+        case KeyRelease:
+            r.detail = e.xkey.keycode;
+            r.state = e.xkey.state;
+            r.time = e.xkey.time;
+            break;
+        default:
+            break;
+    }
+    return r;
+}
+
+XEvent DecodeTraceRecord(const TraceRecord& r) {
+    XEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = r.type;
+    e.xany.serial = r.serial;
+    e.xany.window = r.window;
+    switch (r.type) {
+        case CreateNotify:
+            e.xcreatewindow.window = r.window;
+            e.xcreatewindow.parent = r.aux_window;
+            e.xcreatewindow.x = r.x;
+            e.xcreatewindow.y = r.y;
+            e.xcreatewindow.width = r.width;
+            e.xcreatewindow.height = r.height;
+            e.xcreatewindow.border_width = r.detail;
+            e.xcreatewindow.override_redirect = (r.flags & TRACE_FLAG_OVERRIDE_REDIRECT) != 0;
+            break;
+        case DestroyNotify:
+            e.xdestroywindow.event = r.aux_window;
+            e.xdestroywindow.window = r.window;
+            break;
+        case MotionNotify:
+            e.xmotion.x_root = r.x;
+            e.xmotion.y_root = r.y;
+            e.xmotion.state = r.state;
+            e.xmotion.time = r.time;
+            break;
+        case MapNotify:
+            e.xmap.event = r.aux_window;
+            e.xmap.window = r.window;
+            e.xmap.override_redirect = (r.flags & TRACE_FLAG_OVERRIDE_REDIRECT) != 0;
+            break;
+        case UnmapNotify:
+            e.xunmap.event = r.aux_window;
+            e.xunmap.window = r.window;
+            e.xunmap.from_configure = (r.flags & TRACE_FLAG_FROM_CONFIGURE) != 0;
+            break;
+        case ConfigureNotify:
+            e.xconfigure.event = r.aux_window;
+            e.xconfigure.window = r.window;
+            e.xconfigure.x = r.x;
+            e.xconfigure.y = r.y;
+            e.xconfigure.width = r.width;
+            e.xconfigure.height = r.height;
+            e.xconfigure.border_width = r.detail;
+            e.xconfigure.override_redirect = (r.flags & TRACE_FLAG_OVERRIDE_REDIRECT) != 0;
+            break;
+        case ReparentNotify:
+            e.xreparent.window = r.window;
+            e.xreparent.parent = r.aux_window;
+            e.xreparent.x = r.x;
+            e.xreparent.y = r.y;
+            e.xreparent.override_redirect = (r.flags & TRACE_FLAG_OVERRIDE_REDIRECT) != 0;
+            break;
+        case MapRequest:
+            e.xmaprequest.parent = r.aux_window;
+            e.xmaprequest.window = r.window;
+            break;
+        case ConfigureRequest:
+            e.xconfigurerequest.parent = r.aux_window;
+            e.xconfigurerequest.window = r.window;
+            e.xconfigurerequest.x = r.x;
+            e.xconfigurerequest.y = r.y;
+            e.xconfigurerequest.width = r.width;
+            e.xconfigurerequest.height = r.height;
+            e.xconfigurerequest.border_width = r.detail;
+            e.xconfigurerequest.value_mask = r.state;
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            e.xbutton.x_root = r.x;
+            e.xbutton.y_root = r.y;
+            e.xbutton.button = r.detail;
+            e.xbutton.state = r.state;
+            e.xbutton.time = r.time;
+            break;
+        case KeyPress:
+        case KeyRelease:
+            e.xkey.keycode = r.detail;
+            e.xkey.state = r.state;
+            e.xkey.time = r.time;
+            break;
+        default:
+            break;
+    }
+    return e;
+}
+
+bool TraceRing::Push(const TraceRecord& r) {
+    const size_t head = head_.load(memory_order_relaxed);
+    if (head - tail_.load(memory_order_acquire) == CAPACITY) {
+        return false;
+    }
+    records_[head & (CAPACITY - 1)] = r;
+    head_.store(head + 1, memory_order_release);
+    return true;
+}
+
+bool TraceRing::Pop(TraceRecord* r) {
+    const size_t tail = tail_.load(memory_order_relaxed);
+    if (tail == head_.load(memory_order_acquire)) {
+        return false;
+    }
+    *r = records_[tail & (CAPACITY - 1)];
+    tail_.store(tail + 1, memory_order_release);
+    return true;
+}
+
+Tracer::Tracer() : file_(nullptr), running_(false), dropped_(0) {}
+
+Tracer::~Tracer() {
+    Stop();
+}
+
+bool Tracer::Start(const string& path) {
+    if (running_) {
+        return true;
+    }
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    TraceFileHeader header;
+    memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_FILE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, file_);
+    running_ = true;
+    thread_ = thread(&Tracer::Drain, this);
+    return true;
+}
+
+void Tracer::Stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    thread_.join();
+    fclose(file_);
+    file_ = nullptr;
+    if (dropped() > 0) {
+        fprintf(stderr, "Tracer dropped %llu records (ring full)\n", (unsigned long long) dropped());
+    }
+}
+
+void Tracer::Drain() {
+    const size_t BATCH = 256;
+    TraceRecord batch[BATCH];
+    while (true) {
+        // Read the flag first so a final pass always follows the last Push.
+        const bool running = running_.load();
+        size_t n = 0;
+        while (n < BATCH && ring_.Pop(&batch[n])) {
+            ++n;
+        }
+        if (n > 0) {
+            fwrite(batch, sizeof(TraceRecord), n, file_);
+            continue;
+        }
+        if (!running) {
+            break;
+        }
+        fflush(file_);
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    fflush(file_);
+}
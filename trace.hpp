@@ -0,0 +1,129 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+// Compile-time trace levels. Build with -DLIGHTWM_TRACE_LEVEL=0 (scons trace=0)
+// and the event loop carries no tracing code at all.
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_EVENTS 1
+#define TRACE_LEVEL_VERBOSE 2
+
+#ifndef LIGHTWM_TRACE_LEVEL
+#define LIGHTWM_TRACE_LEVEL TRACE_LEVEL_EVENTS
+#endif
+
+// One traced event. Fixed size so the trace file is a flat array of these
+// behind a small header. Holds enough of the XEvent to rebuild the text that
+// ToString(const XEvent&) prints.
+struct TraceRecord {
+    uint64_t timestamp_ns;  // monotonic clock when dispatch started
+    uint64_t duration_ns;   // time spent in the handler
+    uint64_t serial;
+    uint32_t window;
+    uint32_t aux_window;    // parent or event window, depending on type
+    int32_t x, y;
+    int32_t width, height;
+    uint32_t detail;        // border width, button or keycode
+    uint32_t state;         // state or configure value mask
+    uint32_t time;          // server timestamp for input events
+    uint16_t type;
+    uint8_t flags;          // TRACE_FLAG_* bits
+    uint8_t level;
+};
+static_assert(sizeof(TraceRecord) == 64, "TraceRecord must stay one cache line");
+
+#define TRACE_FLAG_OVERRIDE_REDIRECT 0x01
+#define TRACE_FLAG_FROM_CONFIGURE 0x02
+
+#define TRACE_FILE_MAGIC "LWMTRACE"
+#define TRACE_FILE_VERSION 1
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+TraceRecord EncodeTraceRecord(const XEvent& e);
+XEvent DecodeTraceRecord(const TraceRecord& r);
+
+inline uint64_t TraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Lock-free single-producer/single-consumer ring. The event loop is the only
+// producer and the tracer thread the only consumer.
+class TraceRing {
+    public:
+        static const size_t CAPACITY = 1 << 14;
+        TraceRing() : records_(new TraceRecord[CAPACITY]), head_(0), tail_(0) {}
+        bool Push(const TraceRecord& r);
+        bool Pop(TraceRecord* r);
+
+    private:
+        std::unique_ptr<TraceRecord[]> records_;
+        // Keep the producer and consumer indices on separate cache lines.
+        std::atomic<size_t> head_;
+        char padding_[64 - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail_;
+};
+
+// Drains the ring to a file on a background thread. Records are dropped (and
+// counted) rather than stalling the event loop when the ring is full.
+class Tracer {
+    public:
+        Tracer();
+        ~Tracer();
+        bool Start(const std::string& path);
+        void Stop();
+        // False until Start succeeds; nothing should be recorded before.
+        bool running() const { return running_.load(std::memory_order_relaxed); }
+        void Record(const TraceRecord& r) {
+            if (!ring_.Push(r)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        void Drain();
+        TraceRing ring_;
+        FILE* file_;
+        std::thread thread_;
+        std::atomic<bool> running_;
+        std::atomic<uint64_t> dropped_;
+};
+
+// Times one dispatch in Run() and records it when it goes out of scope.
+// Costs a flag test when the tracer is not running.
+class EventTraceScope {
+    public:
+        EventTraceScope(Tracer& tracer, const XEvent& event)
+            : tracer_(tracer), event_(event), start_ns_(tracer.running() ? TraceNow() : 0) {}
+        ~EventTraceScope() {
+            if (start_ns_ == 0) {
+                return;
+            }
+            TraceRecord r = EncodeTraceRecord(event_);
+            r.timestamp_ns = start_ns_;
+            r.duration_ns = TraceNow() - start_ns_;
+            r.level = TRACE_LEVEL_EVENTS;
+            tracer_.Record(r);
+        }
+
+    private:
+        Tracer& tracer_;
+        const XEvent& event_;
+        const uint64_t start_ns_;
+};
+#endif
@@ -1,13 +1,18 @@
 #include "winman.hpp"
 extern "C" {
+#include <X11/XKBlib.h>
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <signal.h>
-#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
-#include <fcntl.h>
 }
+#include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <map>
+#include <sstream>
 #include "eventnames.hpp"
 
 #define MAX_PANES 10
@@ -22,6 +27,7 @@ extern "C" {
 
 using namespace std;
 bool WindowManager::wm_detected_;
+unsigned long WindowManager::x_errors_;
 mutex WindowManager::wm_detected_mutex_;
 
 unique_ptr<WindowManager> WindowManager::Create(const string& display_str) {
@@ -31,150 +37,717 @@ unique_ptr<WindowManager> WindowManager::Create(const string& display_str) {
 		cerr << "Failed to open X Display" << XDisplayName(display_c_str) << endl;
 		return nullptr;
 	}
-	return unique_ptr<WindowManager>(new WindowManager(display));
+	unique_ptr<XConnection> connection(new XlibConnection(display));
+	const char* audit = getenv("LIGHTWM_AUDIT_ROUND_TRIPS");
+	if (audit != nullptr && strcmp(audit, "0") != 0) {
+		connection.reset(new AuditingConnection(move(connection)));
+	}
+	return Create(move(connection));
 }
 
-WindowManager::WindowManager(Display* display) : 
-    display_handle(display),
-    root_handle(DefaultRootWindow(display_handle)), 
-    WM_PROTOCOLS(XInternAtom(display_handle, "WM_PROTOCOLS", false)),
-    WM_DELETE_WINDOW(XInternAtom(display_handle, "WM_DELETE_WINDOW", false)) {
+unique_ptr<WindowManager> WindowManager::Create(unique_ptr<XConnection> connection) {
+	AtomRegistry atoms;
+	atoms.Resolve(*connection);
+	return unique_ptr<WindowManager>(new WindowManager(move(connection), atoms));
+}
+
+static bool ParseResizeMode(const string& name, ResizeMode* mode) {
+    if (name == "live") {
+        *mode = ResizeMode::Live;
+    } else if (name == "outline") {
+        *mode = ResizeMode::Outline;
+    } else if (name == "sync") {
+        *mode = ResizeMode::Sync;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+WindowManager::WindowManager(unique_ptr<XConnection> connection, const AtomRegistry& atoms) :
+    connection_(move(connection)),
+    audit_(dynamic_cast<AuditingConnection*>(connection_.get())),
+    root_handle(connection_->root()),
+    cache_check_interval_(0),
+    events_since_cache_check_(0),
+    snap_distance_(10),
+    motion_interval_(16),
+    motion_pending_(false),
+    motion_events_received_(0),
+    motion_requests_issued_(0),
+    tiling_(false),
+    drag_frame_(None),
+    drag_client_(None),
+    default_resize_mode_(ResizeMode::Live),
+    drag_mode_(ResizeMode::Live),
+    outline_visible_(false),
+    sync_available_(false),
+    sync_event_base_(0),
+    sync_counter_(None),
+    sync_alarm_(None),
+    sync_value_(0),
+    sync_pending_(false),
+    sync_deferred_(false),
+    focused_client_(None),
+    cycling_focus_(false),
+    focus_cursor_(None),
+    events_dispatched_(0),
+    first_request_(0),
+    dispatch_time_(0),
+    motion_timer_(-1),
+    signal_fd_(-1),
+    atoms_(atoms) {
+    /* 0 applies every coalesced motion event immediately. */
+    const char* interval = getenv("LIGHTWM_MOTION_INTERVAL_MS");
+    if (interval != nullptr) {
+        motion_interval_ = chrono::milliseconds(max(0, atoi(interval)));
+    }
+    /* Debug mode: compare the window cache against the server every N events. */
+    const char* cache_check = getenv("LIGHTWM_CACHE_CHECK");
+    if (cache_check != nullptr) {
+        cache_check_interval_ = max(0, atoi(cache_check));
+    }
+    const char* snap = getenv("LIGHTWM_SNAP_DISTANCE");
+    if (snap != nullptr) {
+        snap_distance_ = max(0, atoi(snap));
+    }
+    const char* layout = getenv("LIGHTWM_LAYOUT");
+    tiling_ = layout != nullptr && strcmp(layout, "tile") == 0;
+    const char* resize_mode = getenv("LIGHTWM_RESIZE_MODE");
+    if (resize_mode != nullptr && !ParseResizeMode(resize_mode, &default_resize_mode_)) {
+        cerr << "Unknown LIGHTWM_RESIZE_MODE " << resize_mode << ", using live" << endl;
+    }
+    InitScreenState();
 }
 
 WindowManager::~WindowManager() {
-	XCloseDisplay(display_handle);
+}
+
+/* The window a structure event is about, rather than the one it was
+ * reported to. */
+static Window EventSubjectWindow(const XEvent& e) {
+    switch (e.type) {
+        case CreateNotify: return e.xcreatewindow.window;
+        case DestroyNotify: return e.xdestroywindow.window;
+        case MapNotify: return e.xmap.window;
+        case UnmapNotify: return e.xunmap.window;
+        case ConfigureNotify: return e.xconfigure.window;
+        case ReparentNotify: return e.xreparent.window;
+        case MapRequest: return e.xmaprequest.window;
+        case ConfigureRequest: return e.xconfigurerequest.window;
+        default: return e.xany.window;
+    }
 }
 
 void WindowManager::Run() {
+    RoundTripScope audit_scope(audit_, "Run");
     {
         lock_guard<mutex> lock(wm_detected_mutex_);
         wm_detected_ = false;
         XSetErrorHandler(&WindowManager::OnWMDetected);
-        XSelectInput(display_handle, root_handle, SubstructureRedirectMask | SubstructureNotifyMask);
-        XSync(display_handle, false);
+        connection_->SelectInput(root_handle, SubstructureRedirectMask | SubstructureNotifyMask);
+        connection_->Sync();
         if (wm_detected_) {//change this reference style
-            cerr << "There is already a window manager for display " << XDisplayString(display_handle);
+            cerr << "There is already a window manager for display " << connection_->name();
             return;
         }
     }
 
     XSetErrorHandler(&WindowManager::OnXError);
-    XGrabServer(display_handle);
-    Window returned_root, returned_parent;
-    Window* top_level_window;
-    unsigned int num_top_level_windows;
-    XQueryTree(display_handle, root_handle, &returned_root, &returned_parent, &top_level_window, &num_top_level_windows);
-    if (XQueryTree == NULL) {
-        cerr << "XQueryTree was NULL" << endl;
-        exit(-1);
+    first_request_ = connection_->NextRequestSerial();
+    StartEwmh();
+    /* Blocked before any thread starts so only the signalfd sees them. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+#if LIGHTWM_TRACE_LEVEL >= TRACE_LEVEL_EVENTS
+    /* Off unless asked for: a trace grows with every event. */
+    const char* trace_path = getenv("LIGHTWM_TRACE");
+    if (trace_path != nullptr && !tracer_.Start(trace_path)) {
+        cerr << "Failed to open " << trace_path << ", tracing disabled" << endl;
     }
-    if (returned_root != root_handle) {
-        cerr << "Returned root did not pass assertion" << endl;
-        exit(-1);
+#endif
+    const char* record_path = getenv("LIGHTWM_RECORD");
+    if (record_path != nullptr && !recorder_.Start(record_path, sync_available_ ? sync_event_base_ : -1)) {
+        cerr << "Failed to open " << record_path << ", recording disabled" << endl;
     }
+    GrabKeys();
+    GrabButtons();
+#ifdef LIGHTWM_COMPOSITOR
+    compositor_.reset(new Compositor(connection_->display()));
+    if (!compositor_->Start(atoms_)) {
+        cerr << "Compositing disabled" << endl;
+        compositor_.reset();
+    }
+#endif
+    AdoptExistingWindows();
 
-    for (unsigned int i = 0; i < num_top_level_windows; ++i) {
-        Frame(top_level_window[i]);
+    event_loop_.Add(connection_->fd(), EPOLLIN, [this](uint32_t) { ProcessXEvents(); });
+    event_loop_.Add(launcher_.signal_fd(), EPOLLIN, [this](uint32_t) { launcher_.ReapChildren(); });
+    event_loop_.Add(signal_fd_, EPOLLIN, [this](uint32_t) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd_, &info, sizeof(info)) != sizeof(info)) {
+            return;
+        }
+        if (info.ssi_signo == SIGUSR1) {
+            cerr << FormatMetrics() << flush;
+            if (audit_ != nullptr) {
+                cerr << audit_->Format() << flush;
+            }
+            return;
+        }
+        cerr << "Received signal " << info.ssi_signo << ", shutting down" << endl;
+        event_loop_.Stop();
+    });
+    motion_timer_ = event_loop_.AddTimer([this](uint32_t) { OnMotionTimer(); });
+    control_.reset(new ControlServer(event_loop_,
+        [this](const vector<string>& words) {
+            RoundTripScope audit_scope(audit_, "OnControlCommand");
+            TaskScope task_scope(metrics_, Metrics::TASK_CONTROL_COMMAND);
+            return OnControlCommand(words);
+        },
+        [this] { connection_->Flush(); }));
+    const string control_path = DefaultControlSocketPath(connection_->name().c_str());
+    control_->Open(control_path);
+    metrics_server_.reset(new MetricsServer(event_loop_, [this] { return FormatMetrics(); }));
+    metrics_server_->Open(DefaultMetricsSocketPath(control_path));
+    /* Xlib may already hold events read during a round trip, which epoll
+     * cannot see, so drain them before every sleep. */
+    event_loop_.Run([this] { ProcessXEvents(); });
+    metrics_server_.reset();
+    control_.reset();
+    recorder_.Stop();
+#ifdef LIGHTWM_COMPOSITOR
+    compositor_.reset();
+#endif
+    connection_->Sync();
+    if (audit_ != nullptr) {
+        cerr << audit_->Format() << flush;
     }
+}
+
+/* Server-side state the handlers rely on, fetched once on construction. */
+void WindowManager::InitScreenState() {
+    key_bindings_.Rebuild(*connection_);
+    sync_available_ = connection_->QuerySync(&sync_event_base_);
+    const Size<int> screen = connection_->screen_size();
+    const Rect screen_rect{0, 0, screen.width, screen.height};
+    layout_.SetArea(screen_rect);
+    snap_index_.SetScreen(screen_rect);
+}
+
+/* Replays a recording against whatever the display currently holds: the
+ * handlers' queries and requests go to the server as they would live, but
+ * windows from the recording are usually gone, so their errors are only
+ * counted. Motion that was coalesced live is coalesced the same way: the
+ * last of a run is dispatched in place of the first. It is not paced. */
+static unsigned long replay_errors;
+
+int WindowManager::OnReplayXError(Display*, XErrorEvent*) {
+    ++replay_errors;
+    return 0;
+}
 
-    XFree(top_level_window);
-    XUngrabServer(display_handle);
+bool WindowManager::Replay(const string& path) {
+    EventRecording recording;
+    if (!recording.Open(path)) {
+        return false;
+    }
+    XSetErrorHandler(&WindowManager::OnReplayXError);
+    motion_interval_ = chrono::milliseconds(0);
+    struct TypeStats {
+        unsigned long count = 0;
+        chrono::nanoseconds total{0};
+        chrono::nanoseconds max{0};
+    };
+    map<int, TypeStats> stats;
+    const int recorded_sync_base = recording.header().sync_event_base;
+    const unsigned long first_request = connection_->NextRequestSerial();
+    const auto start = chrono::steady_clock::now();
+    for (const EventRecord* record = recording.begin(); record != recording.end(); ++record) {
+        if (record->flags & EVENT_RECORD_COALESCED) {
+            continue;
+        }
+        const EventRecord* dispatched = record;
+        while (dispatched + 1 != recording.end() && (dispatched[1].flags & EVENT_RECORD_COALESCED)) {
+            ++dispatched;
+        }
+        XEvent event = DecodeEventRecord(*dispatched, recorded_sync_base);
+        event.xany.display = connection_->display();
+        if (recorded_sync_base >= 0 && event.type == recorded_sync_base + XSyncAlarmNotify) {
+            if (!sync_available_) {
+                continue;
+            }
+            event.type = sync_event_base_ + XSyncAlarmNotify;
+        }
+        const auto dispatch_start = chrono::steady_clock::now();
+        HandleEvent(event);
+        const chrono::nanoseconds elapsed = chrono::steady_clock::now() - dispatch_start;
+        TypeStats& type = stats[record->type];
+        ++type.count;
+        type.total += elapsed;
+        type.max = max(type.max, elapsed);
+    }
+    const chrono::nanoseconds handlers = chrono::steady_clock::now() - start;
+    connection_->Sync();
+    const uint64_t recorded_ns = recording.size() > 1 ?
+        (recording.end() - 1)->timestamp_ns - recording.begin()->timestamp_ns : 0;
+    for (const auto& entry : stats) {
+        const TypeStats& type = entry.second;
+        cout << "{\"type\": \"" << EventTypeName(entry.first) << "\", \"count\": " << type.count
+             << ", \"total_us\": " << chrono::duration_cast<chrono::microseconds>(type.total).count()
+             << ", \"mean_ns\": " << type.total.count() / type.count
+             << ", \"max_ns\": " << type.max.count() << "}" << endl;
+    }
+    cout << "{\"events\": " << recording.size() << ", \"recorded_s\": " << recorded_ns / 1e9
+         << ", \"replay_s\": " << chrono::duration<double>(handlers).count()
+         << ", \"requests\": " << connection_->NextRequestSerial() - first_request
+         << ", \"x_errors\": " << replay_errors << "}" << endl;
+    return true;
+}
 
-    while(1) {
+/* Dispatches everything Xlib has queued or can read without blocking.
+ * XPending also flushes the output buffer once the queue is empty. Layout
+ * changes from the whole batch of events are applied once at the end. */
+void WindowManager::ProcessXEvents() {
+    const auto start = chrono::steady_clock::now();
+    const unsigned long dispatched = events_dispatched_;
+    while (connection_->Pending()) {
         XEvent event;
-        XNextEvent(display_handle, &event);
-        cout << "Event: \"" << ToString(event) << "\" occurred." << endl;
-        switch (event.type) {
-            case CreateNotify:
-                OnCreateNotify(event.xcreatewindow);
-                break;
-            case DestroyNotify:
-                OnDestroyNotify(event.xdestroywindow);
-                break;
-            case ReparentNotify:
-                OnReparentNotify(event.xreparent);
-                break;
-            case MapNotify:
-                OnMapNotify(event.xmap);
-                break;
-            case UnmapNotify:
-                OnUnmapNotify(event.xunmap);
-                break;
-            case ConfigureNotify:
-                OnConfigureNotify(event.xconfigure);
-                break;
-            case MapRequest:
-                OnMapRequest(event.xmaprequest);
-                break;
-            case ConfigureRequest:
-                OnConfigureRequest(event.xconfigurerequest);
-                break;
-            case ButtonPress:
-                OnButtonPress(event.xbutton);
-                break;
-            case MotionNotify:
-                while (XCheckTypedWindowEvent(display_handle, event.xmotion.window, MotionNotify, &event)) {}
+        connection_->NextEvent(&event);
+        if (recorder_.active()) {
+            recorder_.Record(event);
+        }
+        const int type = event.type;
+        const uint64_t handler_start = TraceNow();
+        DispatchEvent(event);
+        metrics_.RecordEvent(type, TraceNow() - handler_start);
+        ++events_dispatched_;
+    }
+    RefreshProperties();
+    ApplyLayout();
+    if (events_dispatched_ != dispatched) {
+        const chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+        dispatch_time_ += elapsed;
+        metrics_.RecordBatch(elapsed.count());
+    }
+#ifdef LIGHTWM_COMPOSITOR
+    /* One repaint for everything damaged by the batch. */
+    if (compositor_) {
+        const uint64_t paint_start = TraceNow();
+        const long long pixels = compositor_->Paint();
+        if (pixels > 0) {
+            metrics_.RecordPaint(TraceNow() - paint_start, pixels);
+        }
+    }
+#endif
+}
+
+void WindowManager::StartEwmh() {
+    ewmh_.Start(connection_.get(), atoms_, "LightWM");
+}
+
+void WindowManager::HandleEvent(XEvent& event) {
+    DispatchEvent(event);
+    RefreshProperties();
+    ApplyLayout();
+}
+
+void WindowManager::HandleEvents(vector<XEvent>& events) {
+    for (XEvent& event : events) {
+        DispatchEvent(event);
+    }
+    RefreshProperties();
+    ApplyLayout();
+}
+
+void WindowManager::DispatchEvent(XEvent& event) {
+    RoundTripScope audit_scope(audit_, event.type);
+#if LIGHTWM_TRACE_LEVEL >= TRACE_LEVEL_EVENTS
+    EventTraceScope trace_scope(tracer_, event);
+#endif
+#if LIGHTWM_TRACE_LEVEL >= TRACE_LEVEL_VERBOSE
+    cout << "Event: \"" << ToString(event) << "\" occurred.\n";
+#endif
+#ifdef LIGHTWM_COMPOSITOR
+    if (compositor_ && compositor_->HandleEvent(event)) {
+        return;
+    }
+#endif
+    switch (event.type) {
+        case CreateNotify:
+            OnCreateNotify(event.xcreatewindow);
+            break;
+        case DestroyNotify:
+            OnDestroyNotify(event.xdestroywindow);
+            break;
+        case ReparentNotify:
+            OnReparentNotify(event.xreparent);
+            break;
+        case MapNotify:
+            OnMapNotify(event.xmap);
+            break;
+        case UnmapNotify:
+            OnUnmapNotify(event.xunmap);
+            break;
+        case ConfigureNotify:
+            OnConfigureNotify(event.xconfigure);
+            break;
+        case MapRequest:
+            OnMapRequest(event.xmaprequest);
+            break;
+        case ConfigureRequest:
+            OnConfigureRequest(event.xconfigurerequest);
+            break;
+        case ButtonPress:
+            OnButtonPress(event.xbutton);
+            break;
+        case ButtonRelease:
+            if (motion_pending_) {
+                FlushMotion();
+            }
+            OnButtonRelease(event.xbutton);
+            break;
+        case MotionNotify:
+            CoalesceMotion(&event);
+            if (motion_interval_.count() == 0) {
                 OnMotionNotify(event.xmotion);
                 break;
-            case KeyPress:
-                OnKeyPress(event.xkey);
-                break;
-            case KeyRelease:
-                OnKeyRelease(event.xkey);
+            }
+            pending_motion_ = event.xmotion;
+            motion_pending_ = true;
+            if (chrono::steady_clock::now() >= next_motion_flush_) {
+                FlushMotion();
+            } else {
+                UpdateMotionTimer();
+            }
+            break;
+        case KeyPress:
+            OnKeyPress(event.xkey);
+            break;
+        case FocusIn:
+            OnFocusIn(event.xfocus);
+            break;
+        case FocusOut:
+            break;
+        case MappingNotify:
+            OnMappingNotify(event.xmapping);
+            break;
+        case KeyRelease:
+            OnKeyRelease(event.xkey);
+            break;
+        case PropertyNotify:
+            OnPropertyNotify(event.xproperty);
+            break;
+        default:
+            if (sync_available_ && event.type == sync_event_base_ + XSyncAlarmNotify) {
+                OnSyncAlarm(reinterpret_cast<const XSyncAlarmNotifyEvent&>(event));
                 break;
-            default:
-                cerr << "Warning: Event ignored" << endl;
+            }
+            cerr << "Warning: Event ignored" << endl;
+    }
+    if (cache_check_interval_ && ++events_since_cache_check_ >= cache_check_interval_) {
+        events_since_cache_check_ = 0;
+        CheckCachedWindow(EventSubjectWindow(event));
+    }
+}
+
+struct DragMotion {
+    XMotionEvent current;
+    // Set by the first queued event that is not motion of the same drag.
+    bool blocked;
+};
+
+/* The queue is visited in order, so once something else comes up the
+ * motion behind it is left for after it. */
+static Bool IsSameDragMotion(Display* display, XEvent* candidate, XPointer arg) {
+    DragMotion* drag = reinterpret_cast<DragMotion*>(arg);
+    const unsigned int buttons = Button1Mask | Button3Mask;
+    if (!drag->blocked && candidate->type == MotionNotify &&
+        candidate->xmotion.window == drag->current.window &&
+        (candidate->xmotion.state & buttons) == (drag->current.state & buttons)) {
+        return True;
+    }
+    drag->blocked = true;
+    return False;
+}
+
+/* Replaces event with the last motion event of the same drag in the run
+ * of them at the head of the queue. Anything else queued (a release, a
+ * key press, a configure) ends the run, so events are never reordered. */
+void WindowManager::CoalesceMotion(XEvent* event) {
+    ++motion_events_received_;
+    DragMotion drag = {event->xmotion, false};
+    while (connection_->CheckIfEvent(event, &IsSameDragMotion, reinterpret_cast<XPointer>(&drag))) {
+        drag.current = event->xmotion;
+        ++motion_events_received_;
+        if (recorder_.active()) {
+            recorder_.Record(*event, EVENT_RECORD_COALESCED);
         }
     }
 }
 
-void WindowManager::Frame(Window w) {
-    const unsigned int BORDER_WIDTH = 1;
+void WindowManager::FlushMotion() {
+    motion_pending_ = false;
+    next_motion_flush_ = chrono::steady_clock::now() + motion_interval_;
+    OnMotionNotify(pending_motion_);
+    UpdateMotionTimer();
+}
+
+/* Arms the motion timer for whichever comes first: the paced flush of
+ * held-back motion, or the deadline of a sync resize whose client has not
+ * answered. Disarms it when neither is waiting. */
+void WindowManager::UpdateMotionTimer() {
+    if (motion_timer_ < 0) {
+        return;
+    }
+    bool waiting = false;
+    chrono::steady_clock::time_point when;
+    if (motion_pending_) {
+        when = next_motion_flush_;
+        waiting = true;
+    }
+    if (sync_deferred_ && (!waiting || sync_deadline_ < when)) {
+        when = sync_deadline_;
+        waiting = true;
+    }
+    if (waiting) {
+        event_loop_.ArmTimer(motion_timer_, when - chrono::steady_clock::now());
+    } else {
+        event_loop_.DisarmTimer(motion_timer_);
+    }
+}
+
+/* A drag paused with motion held back, or a sync client missed its deadline. */
+void WindowManager::OnMotionTimer() {
+    RoundTripScope audit_scope(audit_, "OnMotionTimer");
+    TaskScope task_scope(metrics_, Metrics::TASK_MOTION_TIMER);
+    const auto now = chrono::steady_clock::now();
+    if (motion_pending_ && now >= next_motion_flush_) {
+        FlushMotion();
+    }
+    if (sync_deferred_ && now >= sync_deadline_) {
+        sync_deferred_ = false;
+        OnMotionNotify(sync_deferred_motion_);
+    }
+    UpdateMotionTimer();
+}
+
+/* Selected on every client window. */
+static const long CLIENT_EVENT_MASK = FocusChangeMask | PropertyChangeMask;
+
+/* Frames the windows that were mapped before the WM started. Everything is
+ * fetched in one batch and the Frame requests are only buffered, so the
+ * server stays grabbed for about two round trips regardless of how many
+ * windows exist. */
+void WindowManager::AdoptExistingWindows() {
+    const auto start = chrono::steady_clock::now();
+    connection_->GrabServer();
+    const auto grabbed = chrono::steady_clock::now();
+    vector<Window> top_level_windows;
+    if (!connection_->QueryChildren(root_handle, &top_level_windows)) {
+        cerr << "XQueryTree failed" << endl;
+        connection_->UngrabServer();
+        return;
+    }
+    const vector<WindowInfo> infos = connection_->FetchWindowInfo(top_level_windows, atoms_);
+    unsigned int adopted = 0;
+    for (const WindowInfo& info : infos) {
+        if (!info.valid || info.override_redirect || !info.mapped) {
+            continue;
+        }
+        Frame(info);
+        /* The server is grabbed, so no property can have changed since the fetch. */
+        connection_->SelectInput(info.window, CLIENT_EVENT_MASK);
+        ++adopted;
+    }
+    ApplyLayout();
+    connection_->UngrabServer();
+    connection_->Flush();
+    const auto done = chrono::steady_clock::now();
+    cerr << "Adopted " << adopted << " of " << top_level_windows.size() << " windows in "
+         << chrono::duration_cast<chrono::microseconds>(done - start).count() << "us (server grabbed for "
+         << chrono::duration_cast<chrono::microseconds>(done - grabbed).count() << "us)" << endl;
+}
+
+static const int FRAME_BORDER_WIDTH = 1;
+/* A sync client that has not answered by then is resized anyway. */
+static const chrono::milliseconds SYNC_TIMEOUT(100);
+
+void WindowManager::Frame(const WindowInfo& info) {
+    const Window w = info.window;
     const unsigned long BORDER_COLOR = 0x000000;
     const unsigned long BG_COLOR = 0x000000;
-    if (clients_handle.count(w)) {
-        cerr << "Aborting." << endl;
-        exit(-1);
+    if (clients_handle.Contains(w)) {
+        cerr << "Window " << w << " is already framed" << endl;
+        return;
+    }
+    if (!info.valid) {
+        cerr << "Window " << w << " vanished before it could be framed" << endl;
+        return;
     }
+    const Window frame = connection_->CreateWindow(root_handle, info.position.x, info.position.y, info.size.width, info.size.height, FRAME_BORDER_WIDTH, BORDER_COLOR, BG_COLOR);
+    Client* client = clients_handle.Insert(w, frame);
+    client->geometry.position = info.position;
+    client->geometry.size = info.size;
+    client->geometry.border_width = info.border_width;
+    client->geometry.mapped = info.mapped;
+    client->geometry.override_redirect = info.override_redirect;
+    client->frame_geometry.position = info.position;
+    client->frame_geometry.size = info.size;
+    client->frame_geometry.border_width = FRAME_BORDER_WIDTH;
+    client->frame_geometry.mapped = false;
+    client->frame_geometry.override_redirect = false;
+    client->properties = info.properties;
+    client->resize_mode = default_resize_mode_;
+    ewmh_.AddClient(w);
+    /* From here on the client record is the cache for this window. */
+    window_cache_.erase(w);
 
-    XWindowAttributes x_window_attrs;
-    if (!XGetWindowAttributes(display_handle, w, &x_window_attrs)) {
-        cerr << "Aborting." << endl;
-        exit(-1);
+    connection_->SelectInput(frame, SubstructureRedirectMask | SubstructureNotifyMask);
+    connection_->AddToSaveSet(w);
+    connection_->ReparentWindow(w, frame, 0, 0);
+    connection_->MapWindow(frame);
+    if (tiling_) {
+        /* New windows split the tile of the focused one. */
+        layout_.Insert(w, focused_client_);
     }
-    const Window frame = XCreateSimpleWindow(display_handle, root_handle, x_window_attrs.x, x_window_attrs.y, x_window_attrs.width, x_window_attrs.height, BORDER_WIDTH, BORDER_COLOR, BG_COLOR);
+}
 
-    XSelectInput(display_handle, frame, SubstructureRedirectMask | SubstructureNotifyMask);
-    XAddToSaveSet(display_handle, w);
-    XReparentWindow(display_handle, w, frame, 0, 0);
-    XMapWindow(display_handle, frame);
-    
-    clients_handle[w] = frame;
-    /* Hotkeys defined */
-    XGrabButton(display_handle, Button1, Mod1Mask, w, false, ButtonPressMask | ButtonMotionMask, GrabModeAsync, GrabModeAsync, None, None);
-    XGrabKey(display_handle, XKeysymToKeycode(display_handle, XK_Q), Mod1Mask, w, false, GrabModeAsync, GrabModeAsync);
-    XGrabKey(display_handle, XKeysymToKeycode(display_handle, XK_Return), Mod1Mask, w, false, GrabModeAsync, GrabModeAsync);
-    XGrabKey(display_handle, XKeysymToKeycode(display_handle, XK_Tab), Mod1Mask, w, false, GrabModeAsync, GrabModeAsync);
+/* Lock and NumLock would otherwise stop a grab from matching. */
+static const unsigned int LOCK_MODIFIER_VARIANTS[] = {0, LockMask, Mod2Mask, LockMask | Mod2Mask};
+
+/* Hotkeys and mouse bindings are grabbed once on the root window; the
+ * target client is resolved from the event in OnKeyPress/OnButtonPress. */
+void WindowManager::GrabKeys() {
+    for (const auto& grab : key_bindings_.grabs()) {
+        for (unsigned int locks : LOCK_MODIFIER_VARIANTS) {
+            connection_->GrabKey(grab.first, grab.second | locks);
+        }
+    }
+}
+
+void WindowManager::GrabButtons() {
+    for (unsigned int button : {Button1, Button3}) {
+        for (unsigned int locks : LOCK_MODIFIER_VARIANTS) {
+            connection_->GrabButton(button, Mod1Mask | locks, ButtonPressMask | ButtonReleaseMask | ButtonMotionMask);
+        }
+    }
+}
+
+/* Focus as the WM last saw it, falling back to the frame under the pointer. */
+Window WindowManager::KeyTarget(const XKeyEvent& e) {
+    if (focused_client_ != None && clients_handle.Contains(focused_client_)) {
+        return focused_client_;
+    }
+    const Client* client = clients_handle.FindByFrame(e.subwindow);
+    return client ? client->window : None;
 }
 
 void WindowManager::Unframe(Window w) {
-    if (clients_handle.count(w) == 0) {
+    const Client* client = clients_handle.Find(w);
+    if (client == nullptr) {
         cerr << "Client count did not pass assertion" << endl;
+        return;
+    }
+    const Window frame = client->frame;
+    snap_index_.Remove(frame);
+    if (focus_cursor_ == w) {
+        focus_cursor_ = clients_handle.size() > 1 ? clients_handle.FocusNext(client)->window : None;
+    }
+    connection_->UnmapWindow(frame);
+    connection_->ReparentWindow(w, root_handle, 0, 0);
+    connection_->RemoveFromSaveSet(w);
+    connection_->DestroyWindow(frame);
+    clients_handle.Erase(w);
+    layout_.Remove(w);
+    ewmh_.RemoveClient(w);
+    if (focused_client_ == w) {
+        SetFocusedClient(None);
+    }
+}
+
+/* Moves and resizes the frames whose tiles changed since the last call and
+ * flushes them together. Returns the number of frames touched. */
+size_t WindowManager::ApplyLayout() {
+    if (!tiling_) {
+        return 0;
+    }
+    const vector<LayoutChange>& changes = layout_.Update();
+    for (const LayoutChange& change : changes) {
+        const Client* client = clients_handle.Find(change.window);
+        if (client == nullptr) {
+            continue;
+        }
+        const int width = max(1, change.rect.width - 2 * FRAME_BORDER_WIDTH);
+        const int height = max(1, change.rect.height - 2 * FRAME_BORDER_WIDTH);
+        connection_->MoveResizeWindow(client->frame, change.rect.x, change.rect.y, width, height);
+        connection_->ResizeWindow(client->window, width, height);
+    }
+    if (!changes.empty()) {
+        connection_->Flush();
+    }
+    return changes.size();
+}
+
+/* The cached geometry of a client, a frame or any other known window. */
+CachedWindow* WindowManager::CachedGeometry(Window w) {
+    if (Client* client = clients_handle.Find(w)) {
+        return &client->geometry;
+    }
+    if (Client* client = clients_handle.FindByFrame(w)) {
+        return &client->frame_geometry;
+    }
+    const auto cached = window_cache_.find(w);
+    return cached != window_cache_.end() ? &cached->second : nullptr;
+}
+
+void WindowManager::OnCreateNotify(const XCreateWindowEvent &event) {
+    if (clients_handle.FindByFrame(event.window)) {
+        return;
+    }
+    CachedWindow& entry = window_cache_[event.window];
+    entry.position = Position<int>(event.x, event.y);
+    entry.size = Size<int>(event.width, event.height);
+    entry.border_width = event.border_width;
+    entry.mapped = false;
+    entry.override_redirect = event.override_redirect;
+}
+
+void WindowManager::OnDestroyNotify(const XDestroyWindowEvent &event) {
+    window_cache_.erase(event.window);
+}
+
+void WindowManager::OnMapNotify(const XMapEvent &event) {
+    if (CachedWindow* cached = CachedGeometry(event.window)) {
+        cached->mapped = true;
+        cached->override_redirect = event.override_redirect;
+    }
+    if (const Client* client = clients_handle.FindByFrame(event.window)) {
+        UpdateSnapIndex(*client);
+    }
+}
+
+void WindowManager::OnReparentNotify(const XReparentEvent &event) {
+    if (CachedWindow* cached = CachedGeometry(event.window)) {
+        cached->position = Position<int>(event.x, event.y);
+        cached->override_redirect = event.override_redirect;
     }
-    const Window frame = clients_handle[w];
-    XUnmapWindow(display_handle, frame);
-    XReparentWindow(display_handle, w, root_handle, 0, 0);
-    XRemoveFromSaveSet(display_handle, w);
-    XDestroyWindow(display_handle, frame);
-    clients_handle.erase(w);
 }
 
-void WindowManager::OnCreateNotify(const XCreateWindowEvent &event) {}
-void WindowManager::OnDestroyNotify(const XDestroyWindowEvent &event) {}
-void WindowManager::OnMapNotify(const XMapEvent &event) {}
-void WindowManager::OnReparentNotify(const XReparentEvent &event) {}
 void WindowManager::OnUnmapNotify(const XUnmapEvent &event) {
-    if (clients_handle.count(event.window) == 0) {
+    if (CachedWindow* cached = CachedGeometry(event.window)) {
+        cached->mapped = false;
+    }
+    if (const Client* client = clients_handle.FindByFrame(event.window)) {
+        UpdateSnapIndex(*client);
+    }
+    if (!clients_handle.Contains(event.window)) {
         cerr << "Ignore UnmapNotify for window that isn't a client." << endl;
         return;
     }
@@ -184,10 +757,44 @@ void WindowManager::OnUnmapNotify(const XUnmapEvent &event) {
     Unframe(event.window);
 }
 
-void WindowManager::OnConfigureNotify(const XConfigureEvent &event) {}
+void WindowManager::OnConfigureNotify(const XConfigureEvent &event) {
+    CachedWindow* cached = CachedGeometry(event.window);
+    if (cached == nullptr) {
+        return;
+    }
+    cached->position = Position<int>(event.x, event.y);
+    cached->size = Size<int>(event.width, event.height);
+    cached->border_width = event.border_width;
+    cached->override_redirect = event.override_redirect;
+    if (const Client* client = clients_handle.FindByFrame(event.window)) {
+        UpdateSnapIndex(*client);
+    }
+}
+
+/* Where the dragged frame goes when moved to position, after snapping
+ * its edges to the screen and to neighbouring frames. */
+Position<int> WindowManager::SnapFrame(const Position<int>& position) {
+    const int border = 2 * FRAME_BORDER_WIDTH;
+    const Rect rect{position.x, position.y, drag_start_frame_size_.width + border, drag_start_frame_size_.height + border};
+    return snap_index_.Snap(drag_frame_, rect, snap_distance_);
+}
+
+/* Mapped frames are in the snap index with their outer rectangle. */
+void WindowManager::UpdateSnapIndex(const Client& client) {
+    const CachedWindow& g = client.frame_geometry;
+    if (!g.mapped) {
+        snap_index_.Remove(client.frame);
+        return;
+    }
+    snap_index_.Update(client.frame, Rect{g.position.x, g.position.y, g.size.width + 2 * g.border_width, g.size.height + 2 * g.border_width});
+}
 void WindowManager::OnMapRequest(const XMapRequestEvent &event) {
-    Frame(event.window);
-    XMapWindow(display_handle, event.window);
+    /* Selected before the fetch, so no property change falls in between. */
+    connection_->SelectInput(event.window, CLIENT_EVENT_MASK);
+    /* Attributes, geometry and properties in one round trip. */
+    const WindowInfo info = connection_->FetchWindowInfo({event.window}, atoms_)[0];
+    Frame(info);
+    connection_->MapWindow(event.window);
 }
 
 void WindowManager::OnConfigureRequest(const XConfigureRequestEvent &event) {
@@ -199,100 +806,503 @@ void WindowManager::OnConfigureRequest(const XConfigureRequestEvent &event) {
     changes.border_width = event.border_width;
     changes.sibling = event.above;
     changes.stack_mode = event.detail;
-    if (clients_handle.count(event.window)) {
-        const Window frame = clients_handle[event.window];
-        XConfigureWindow(display_handle, frame, event.value_mask, &changes);
+    const Rect* tile = tiling_ ? layout_.TileOf(event.window) : nullptr;
+    if (tile != nullptr) {
+        /* Tiled clients keep their tile; only the client's own size is
+         * brought back in line with it. */
+        connection_->ResizeWindow(event.window, max(1, tile->width - 2 * FRAME_BORDER_WIDTH), max(1, tile->height - 2 * FRAME_BORDER_WIDTH));
+        return;
+    }
+    if (const Client* client = clients_handle.Find(event.window)) {
+        const Window frame = client->frame;
+        connection_->ConfigureWindow(frame, event.value_mask, changes);
         cerr << "Frame resized to " << Size<int>(event.width, event.height);
     }
-    XConfigureWindow(display_handle, event.window, event.value_mask, &changes);
+    connection_->ConfigureWindow(event.window, event.value_mask, changes);
     cerr << "Window resized to " << Size<int>(event.width, event.height);
 }
 
 void WindowManager::OnButtonPress(const XButtonEvent &event) {
-    //CHECK(clients_handle.count(event.window));
-    if (clients_handle.count(event.window) == 0) {
-        cerr << "Client count for the event's window did not pass assertion (>0)" << endl;
+    if (outline_visible_) {
+        return;
     }
-    const Window frame = clients_handle[event.window];
+    /* The grab is on the root window; subwindow is the frame under the pointer. */
+    const Client* client = clients_handle.FindByFrame(event.subwindow);
+    if (client == nullptr) {
+        drag_frame_ = None;
+        return;
+    }
+    const Window frame = client->frame;
+    drag_frame_ = frame;
+    drag_client_ = client->window;
     drag_start_pos_ = Position<int>(event.x_root, event.y_root);
-    Window returned_root;
-    int x, y;
-    unsigned width, height, border_width, depth;
-    if (!XGetGeometry(display_handle, frame, &returned_root, &x, &y, &width, &height, &border_width, &depth)) {
-        cerr << "XGetGeometry failed for some reason" << endl;
+    drag_start_frame_pos_ = client->frame_geometry.position;
+    drag_start_frame_size_ = client->frame_geometry.size;
+    connection_->RaiseWindow(frame);
+    motion_events_received_ = 0;
+    motion_requests_issued_ = 0;
+    drag_mode_ = tiling_ && layout_.Contains(drag_client_) ? ResizeMode::Live : client->resize_mode;
+    if (drag_mode_ == ResizeMode::Sync && !StartSyncResize(*client)) {
+        drag_mode_ = ResizeMode::Live;
+    }
+    if (drag_mode_ == ResizeMode::Outline) {
+        /* Nothing may draw over the outline while it is up. */
+        connection_->GrabServer();
+        outline_pos_ = drag_start_frame_pos_;
+        outline_size_ = drag_start_frame_size_;
+        DrawOutline();
+        outline_visible_ = true;
+    }
+}
+
+void WindowManager::OnButtonRelease(const XButtonEvent &event) {
+    if (drag_frame_ != None && drag_mode_ == ResizeMode::Outline && outline_visible_) {
+        DrawOutline();
+        outline_visible_ = false;
+        connection_->UngrabServer();
+        if (clients_handle.Contains(drag_client_)) {
+            connection_->MoveResizeWindow(drag_frame_, outline_pos_.x, outline_pos_.y, outline_size_.width, outline_size_.height);
+            connection_->ResizeWindow(drag_client_, outline_size_.width, outline_size_.height);
+            motion_requests_issued_ += 2;
+        }
+    }
+    if (drag_mode_ == ResizeMode::Sync) {
+        /* The last size is applied even if the client never answered. */
+        if (sync_deferred_) {
+            sync_pending_ = false;
+            sync_deferred_ = false;
+            OnMotionNotify(sync_deferred_motion_);
+        }
+        EndSyncResize();
+    }
+    drag_mode_ = ResizeMode::Live;
+    if (motion_events_received_ > 0) {
+        metrics_.RecordDrag(motion_events_received_, motion_requests_issued_);
+    }
+}
+
+/* Draws, or erases when drawn a second time, the rubber band of an outline
+ * drag around the frame's outer edge. */
+void WindowManager::DrawOutline() {
+    connection_->DrawOutline(outline_pos_.x, outline_pos_.y,
+        outline_size_.width + 2 * FRAME_BORDER_WIDTH - 1, outline_size_.height + 2 * FRAME_BORDER_WIDTH - 1);
+}
+
+/* Looks up the client's sync counter and sets an alarm on it. Returns
+ * false if the client does not take part in _NET_WM_SYNC_REQUEST. */
+bool WindowManager::StartSyncResize(const Client& client) {
+    if (!sync_available_ || !client.properties.Supports(atoms_[AtomId::NET_WM_SYNC_REQUEST])) {
+        return false;
+    }
+    EndSyncResize();
+    unsigned long counter;
+    if (!connection_->GetCardinalProperty(client.window, atoms_[AtomId::NET_WM_SYNC_REQUEST_COUNTER], &counter) || counter == None ||
+        !connection_->QueryCounter(counter, &sync_value_)) {
+        return false;
     }
-    drag_start_frame_pos_ = Position<int>(x, y);
-    drag_start_frame_size_ = Size<int>(width, height);
-    XRaiseWindow(display_handle, frame);
+    sync_counter_ = counter;
+    sync_alarm_ = connection_->CreateAlarm(sync_counter_, sync_value_);
+    sync_pending_ = false;
+    sync_deferred_ = false;
+    return true;
 }
 
-void WindowManager::OnButtonRelease(const XButtonEvent &event) {}
+/* Asks the client to bump its counter to the next value once it has
+ * redrawn after the resize that follows, and arms the alarm for it. */
+void WindowManager::SendSyncRequest(Time time) {
+    ++sync_value_;
+    XEvent msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.xclient.type = ClientMessage;
+    msg.xclient.message_type = atoms_[AtomId::WM_PROTOCOLS];
+    msg.xclient.window = drag_client_;
+    msg.xclient.format = 32;
+    msg.xclient.data.l[0] = atoms_[AtomId::NET_WM_SYNC_REQUEST];
+    msg.xclient.data.l[1] = time;
+    msg.xclient.data.l[2] = static_cast<unsigned long>(sync_value_ & 0xffffffff);
+    msg.xclient.data.l[3] = static_cast<unsigned long>(sync_value_ >> 32);
+    connection_->SendEvent(drag_client_, msg);
+    connection_->ChangeAlarm(sync_alarm_, sync_value_);
+    sync_pending_ = true;
+    sync_deadline_ = chrono::steady_clock::now() + SYNC_TIMEOUT;
+}
+
+void WindowManager::OnSyncAlarm(const XSyncAlarmNotifyEvent& event) {
+    if (event.alarm != sync_alarm_ || drag_mode_ != ResizeMode::Sync) {
+        return;
+    }
+    const int64_t value = (static_cast<int64_t>(XSyncValueHigh32(event.counter_value)) << 32) | XSyncValueLow32(event.counter_value);
+    if (value < sync_value_) {
+        return;
+    }
+    sync_pending_ = false;
+    if (sync_deferred_) {
+        sync_deferred_ = false;
+        OnMotionNotify(sync_deferred_motion_);
+        UpdateMotionTimer();
+    }
+}
+
+void WindowManager::EndSyncResize() {
+    if (sync_alarm_ != None) {
+        connection_->DestroyAlarm(sync_alarm_);
+    }
+    sync_alarm_ = None;
+    sync_counter_ = None;
+    sync_pending_ = false;
+    sync_deferred_ = false;
+    UpdateMotionTimer();
+}
 void WindowManager::OnMotionNotify(const XMotionEvent &event) {
-    //CHECK(clients_handle.count(event.window));
-    if (clients_handle.count(event.window) == 0) {
-        cerr << "Client count for the event's window did not pass assertion (>0)" << endl;
+    if (drag_frame_ == None || !clients_handle.Contains(drag_client_)) {
+        return;
     }
-    const Window frame = clients_handle[event.window];
+    const Window frame = drag_frame_;
     const Position<int> drag_pos(event.x_root, event.y_root);
     const Vector2D<int> delta = drag_pos - drag_start_pos_;
+    if (tiling_ && layout_.Contains(drag_client_)) {
+        if (event.state & Button3Mask) {
+            /* Resizing a tile moves the split it shares with its sibling. */
+            const Vector2D<int> size_delta(max(delta.x, -drag_start_frame_size_.width), max(delta.y, -drag_start_frame_size_.height));
+            const Vector2D<int> borders(2 * FRAME_BORDER_WIDTH, 2 * FRAME_BORDER_WIDTH);
+            layout_.Resize(drag_client_, drag_start_frame_size_ + size_delta + borders);
+            motion_requests_issued_ += 2 * ApplyLayout();
+        }
+        return;
+    }
+    if (drag_mode_ == ResizeMode::Outline) {
+        DrawOutline();
+        if (event.state & Button1Mask) {
+            outline_pos_ = SnapFrame(drag_start_frame_pos_ + delta);
+        } else if (event.state & Button3Mask) {
+            const Vector2D<int> size_delta(max(delta.x, 1 - drag_start_frame_size_.width), max(delta.y, 1 - drag_start_frame_size_.height));
+            outline_size_ = drag_start_frame_size_ + size_delta;
+        }
+        DrawOutline();
+        return;
+    }
     if (event.state & Button1Mask) {
-        const Position<int> dest_frame_pos = drag_start_frame_pos_ + delta;
-        XMoveWindow(display_handle, frame, dest_frame_pos.x, dest_frame_pos.y);
+        const Position<int> dest_frame_pos = SnapFrame(drag_start_frame_pos_ + delta);
+        connection_->MoveWindow(frame, dest_frame_pos.x, dest_frame_pos.y);
+        motion_requests_issued_ += 1;
     } else if (event.state & Button3Mask) {
+        if (drag_mode_ == ResizeMode::Sync) {
+            /* Hold the newest size back while the client is still drawing
+             * the previous one. */
+            if (sync_pending_ && chrono::steady_clock::now() < sync_deadline_) {
+                sync_deferred_motion_ = event;
+                sync_deferred_ = true;
+                UpdateMotionTimer();
+                return;
+            }
+            SendSyncRequest(event.time);
+        }
         const Vector2D<int> size_delta(max(delta.x, -drag_start_frame_size_.width), max(delta.y, -drag_start_frame_size_.height));
         const Size<int> dest_frame_size = drag_start_frame_size_ + size_delta;
-        XResizeWindow(display_handle, frame, dest_frame_size.width, dest_frame_size.height);
-        XResizeWindow(display_handle, event.window, dest_frame_size.width, dest_frame_size.height);
+        connection_->ResizeWindow(frame, dest_frame_size.width, dest_frame_size.height);
+        connection_->ResizeWindow(drag_client_, dest_frame_size.width, dest_frame_size.height);
+        motion_requests_issued_ += 2;
     }
 }
 
 void WindowManager::OnKeyPress(const XKeyEvent &e) {
-    if ((e.state & Mod1Mask) && (e.keycode == XKeysymToKeycode(display_handle, XK_Q))) {
-        Atom* supported_protocols;
-        int num_supported_protocols;
-        if (XGetWMProtocols(display_handle, e.window, &supported_protocols, &num_supported_protocols) && (find(supported_protocols, supported_protocols + num_supported_protocols, WM_DELETE_WINDOW) != supported_protocols + num_supported_protocols)) {
-            cerr << "Deleting window" << e.window << endl;
-            XEvent msg;
-            memset(&msg, 0, sizeof(msg));
-            msg.xclient.type = ClientMessage;
-            msg.xclient.message_type = WM_PROTOCOLS;
-            msg.xclient.window = e.window;
-            msg.xclient.format = 32;
-            msg.xclient.data.l[0] = WM_DELETE_WINDOW;
-            if (XSendEvent(display_handle, e.window, false, 0, &msg))
-            {
-                cerr << "Failed to send event to X (delete message)" << endl;
-            }
-        } else {
-            cerr << "Killing window " << e.window << endl;
-            XKillClient(display_handle, e.window);
+    const Window target = KeyTarget(e);
+    switch (key_bindings_.Lookup(e.keycode, e.state)) {
+    case Action::CloseWindow: {
+        if (target == None) {
+            break;
         }
-    } 
-    else if ((e.state & Mod1Mask) && (e.keycode == XKeysymToKeycode(display_handle, XK_Return)))
-    {
-        char xterm[6];
-        strcpy(xterm, "xterm&");
-        execute(xterm);
-
-    } else if ((e.state & Mod1Mask) && (e.keycode == XKeysymToKeycode(display_handle, XK_Tab))) {
-        auto i = clients_handle.find(e.window);
-        //CHECK(i != clients_handle.end());
-        if (i == clients_handle.end())
+        CloseClient(target);
+        break;
+    }
+    case Action::LaunchTerminal: {
+        launcher_.LaunchCommand("xterm");
+        break;
+    }
+    case Action::FocusNext:
+        CycleFocus(target, true);
+        break;
+    case Action::FocusPrevious:
+        CycleFocus(target, false);
+        break;
+    case Action::NoAction:
+        break;
+    }
+}
+
+/* Asks the client to close via WM_DELETE_WINDOW if it supports it, and
+ * kills its connection otherwise. */
+void WindowManager::CloseClient(Window w) {
+    /* A WM_PROTOCOLS change earlier in this batch has not been fetched yet. */
+    if (stale_properties_.count(w)) {
+        RefreshProperties();
+    }
+    const Client* client = clients_handle.Find(w);
+    if (client != nullptr && client->properties.Supports(atoms_[AtomId::WM_DELETE_WINDOW])) {
+        cerr << "Deleting window" << w << endl;
+        XEvent msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.xclient.type = ClientMessage;
+        msg.xclient.message_type = atoms_[AtomId::WM_PROTOCOLS];
+        msg.xclient.window = w;
+        msg.xclient.format = 32;
+        msg.xclient.data.l[0] = atoms_[AtomId::WM_DELETE_WINDOW];
+        if (!connection_->SendEvent(w, msg))
         {
-            cerr << "Assertion failed, window not found" << endl;
+            cerr << "Failed to send event to X (delete message)" << endl;
+        }
+    } else {
+        cerr << "Killing window " << w << endl;
+        connection_->KillClient(w);
+    }
+}
+
+/* Steps through the MRU ring from the current client. The first step grabs
+ * the keyboard so the Alt release that ends the cycle reaches us. */
+void WindowManager::CycleFocus(Window target, bool forward) {
+    if (clients_handle.empty()) {
+        return;
+    }
+    if (!cycling_focus_) {
+        focus_cursor_ = clients_handle.Contains(target) ? target : clients_handle.FocusFront()->window;
+        cycling_focus_ = connection_->GrabKeyboard();
+    }
+    const Client* cursor = clients_handle.Find(focus_cursor_);
+    if (cursor == nullptr) {
+        cursor = clients_handle.FocusFront();
+    }
+    cursor = forward ? clients_handle.FocusNext(cursor) : clients_handle.FocusPrev(cursor);
+    connection_->RaiseWindow(cursor->frame);
+    connection_->SetInputFocus(cursor->window);
+    SetFocusedClient(cursor->window);
+    focus_cursor_ = cursor->window;
+    if (!cycling_focus_) {
+        clients_handle.TouchFocus(cursor);
+        focus_cursor_ = None;
+    }
+}
+
+void WindowManager::EndFocusCycle() {
+    connection_->UngrabKeyboard();
+    cycling_focus_ = false;
+    if (const Client* cursor = clients_handle.Find(focus_cursor_)) {
+        clients_handle.TouchFocus(cursor);
+    }
+    focus_cursor_ = None;
+}
+
+void WindowManager::OnKeyRelease(const XKeyEvent &e) {
+    if (!cycling_focus_) {
+        return;
+    }
+    const KeySym keysym = connection_->KeycodeToKeysym(e.keycode);
+    if (keysym == XK_Alt_L || keysym == XK_Alt_R || keysym == XK_Meta_L || keysym == XK_Meta_R) {
+        EndFocusCycle();
+    }
+}
+
+/* Only marks the property; the batch's changes are fetched together. */
+void WindowManager::OnPropertyNotify(const XPropertyEvent& event) {
+    const unsigned int bit = PropertyBit(event.atom, atoms_);
+    if (bit != 0 && clients_handle.Contains(event.window)) {
+        stale_properties_[event.window] |= bit;
+    }
+}
+
+/* Fetches every property marked since the last call, for all clients, in
+ * one round trip. Runs once per batch of events, before the layout. */
+void WindowManager::RefreshProperties() {
+    if (stale_properties_.empty()) {
+        return;
+    }
+    RoundTripScope audit_scope(audit_, "RefreshProperties");
+    TaskScope task_scope(metrics_, Metrics::TASK_REFRESH_PROPERTIES);
+    vector<PropertyFetch> fetches;
+    for (const auto& stale : stale_properties_) {
+        Client* client = clients_handle.Find(stale.first);
+        if (client != nullptr) {
+            fetches.push_back(PropertyFetch{stale.first, stale.second, &client->properties});
         }
-        ++i;
-        if (i == clients_handle.end()) {
-            i = clients_handle.begin();
+    }
+    stale_properties_.clear();
+    if (!fetches.empty()) {
+        connection_->FetchProperties(fetches, atoms_);
+    }
+}
+
+/* Every focus change goes through here so _NET_ACTIVE_WINDOW follows it. */
+void WindowManager::SetFocusedClient(Window w) {
+    focused_client_ = w;
+    ewmh_.SetActiveWindow(w);
+}
+
+/* Focus changes from outside ALT+Tab (clicks, clients, the control socket)
+ * move the client to the front of the MRU ring. */
+void WindowManager::OnFocusIn(const XFocusChangeEvent &e) {
+    if (e.mode == NotifyGrab || e.mode == NotifyUngrab) {
+        return;
+    }
+    const Client* client = clients_handle.Find(e.window);
+    if (client == nullptr) {
+        return;
+    }
+    SetFocusedClient(e.window);
+    if (!cycling_focus_) {
+        clients_handle.TouchFocus(client);
+    }
+}
+
+/* One command from the control socket; see control.hpp for the protocol.
+ * Requests are only buffered here, the server flushes once per batch. */
+string WindowManager::OnControlCommand(const vector<string>& words) {
+    const string& command = words[0];
+    if (command == "stats") {
+        ostringstream out;
+        out << "ok events " << events_dispatched_ << " requests " << connection_->NextRequestSerial() - first_request_
+            << " busy_us " << chrono::duration_cast<chrono::microseconds>(dispatch_time_).count();
+        return out.str();
+    }
+    if (command == "roundtrips") {
+        if (audit_ == nullptr) {
+            return "error not auditing, set LIGHTWM_AUDIT_ROUND_TRIPS=1";
+        }
+        /* handler request count blocked_us, per handler and request. */
+        ostringstream out;
+        out << "ok";
+        const char* separator = " ";
+        for (const auto& handler : audit_->report()) {
+            for (const auto& request : handler.second) {
+                out << separator << handler.first << " " << request.first << " " << request.second.count << " "
+                    << chrono::duration_cast<chrono::microseconds>(request.second.blocked).count();
+                separator = ";";
+            }
+        }
+        return out.str();
+    }
+    if (command == "list") {
+        const size_t first = words.size() > 1 ? strtoul(words[1].c_str(), nullptr, 0) : 0;
+        /* Room for the ";next <n>" that ends a page. */
+        const size_t page_size = CONTROL_MAX_MESSAGE - 32;
+        string reply = "ok";
+        const char* separator = " ";
+        /* Most recently focused first. */
+        const Client* client = clients_handle.FocusFront();
+        for (size_t i = 0; i < clients_handle.size(); ++i, client = clients_handle.FocusNext(client)) {
+            if (i < first) {
+                continue;
+            }
+            const CachedWindow& geometry = client->frame_geometry;
+            ostringstream entry;
+            entry << separator << "0x" << hex << client->window << " 0x" << client->frame << dec << " "
+                  << geometry.position.x << " " << geometry.position.y << " "
+                  << geometry.size.width << " " << geometry.size.height;
+            if (reply.size() + entry.str().size() > page_size) {
+                return reply + separator + "next " + to_string(i);
+            }
+            reply += entry.str();
+            separator = ";";
+        }
+        return reply;
+    }
+    if (command == "launch") {
+        if (words.size() < 2) {
+            return "error usage: launch <command line>";
+        }
+        vector<string> rest(words.begin() + 1, words.end());
+        return launcher_.LaunchCommand(Join(rest, " ")) > 0 ? "ok" : "error launch failed";
+    }
+    if (words.size() < 2) {
+        return "error usage: " + command + " <window> ...";
+    }
+    const Window w = strtoul(words[1].c_str(), nullptr, 0);
+    const Client* client = clients_handle.Find(w);
+    if (client == nullptr) {
+        return "error not a client: " + words[1];
+    }
+    const Window frame = client->frame;
+    /* Tiled clients keep their tile, as in OnConfigureRequest. */
+    if ((command == "move" || command == "resize") && tiling_ && layout_.TileOf(w) != nullptr) {
+        return "error tiled: " + words[1];
+    }
+    if (command == "move" && words.size() == 4) {
+        connection_->MoveWindow(frame, atoi(words[2].c_str()), atoi(words[3].c_str()));
+    } else if (command == "resize" && words.size() == 4) {
+        const int width = max(1, atoi(words[2].c_str()));
+        const int height = max(1, atoi(words[3].c_str()));
+        connection_->ResizeWindow(frame, width, height);
+        connection_->ResizeWindow(w, width, height);
+    } else if (command == "raise") {
+        connection_->RaiseWindow(frame);
+    } else if (command == "focus") {
+        connection_->RaiseWindow(frame);
+        connection_->SetInputFocus(w);
+        SetFocusedClient(w);
+    } else if (command == "close") {
+        CloseClient(w);
+    } else if (command == "resize-mode" && words.size() == 3) {
+        if (!ParseResizeMode(words[2], &clients_handle.Find(w)->resize_mode)) {
+            return "error unknown resize mode: " + words[2];
         }
-        XRaiseWindow(display_handle, i->second);
-        XSetInputFocus(display_handle, i->first, RevertToPointerRoot, CurrentTime);
+    } else {
+        return "error unknown command or wrong arguments: " + command;
+    }
+    return "ok";
+}
+
+string WindowManager::FormatMetrics() const {
+    ostringstream out;
+    out << metrics_.Format(events_dispatched_, connection_->NextRequestSerial() - first_request_, x_errors_)
+        << "# HELP lightwm_launches_total Programs spawned.\n"
+        << "# TYPE lightwm_launches_total counter\n"
+        << "lightwm_launches_total " << launcher_.launches() << "\n"
+        << "# HELP lightwm_launch_failures_total Spawns that failed.\n"
+        << "# TYPE lightwm_launch_failures_total counter\n"
+        << "lightwm_launch_failures_total " << launcher_.failures() << "\n"
+        << "# HELP lightwm_launch_spawn_seconds_total Time spent in posix_spawn.\n"
+        << "# TYPE lightwm_launch_spawn_seconds_total counter\n"
+        << "lightwm_launch_spawn_seconds_total " << launcher_.total_spawn_time().count() / 1e9 << "\n"
+        << "# HELP lightwm_launch_spawn_max_seconds Slowest spawn.\n"
+        << "# TYPE lightwm_launch_spawn_max_seconds gauge\n"
+        << "lightwm_launch_spawn_max_seconds " << launcher_.max_spawn_time().count() / 1e9 << "\n";
+    return out.str();
+}
+
+/* Keycodes only change here, so this is the one place keysyms are resolved
+ * again and the grabs redone. */
+void WindowManager::OnMappingNotify(XMappingEvent &e) {
+    connection_->RefreshKeyboardMapping(&e);
+    if (e.request != MappingKeyboard && e.request != MappingModifier) {
+        return;
     }
+    key_bindings_.Rebuild(*connection_);
+    connection_->UngrabAllKeys();
+    GrabKeys();
 }
 
-void WindowManager::OnKeyRelease(const XKeyEvent &e) {}
+/* Debug mode only: round trip to the server and report any cached field
+ * that disagrees. Skipped while events are queued, since those may still
+ * carry the update. */
+void WindowManager::CheckCachedWindow(Window w) {
+    const CachedWindow* cached = CachedGeometry(w);
+    if (cached == nullptr) {
+        return;
+    }
+    XWindowAttributes attrs;
+    if (!connection_->GetWindowAttributes(w, &attrs) || connection_->QueuedEvents() > 0) {
+        return;
+    }
+    const CachedWindow& c = *cached;
+    const bool mapped = attrs.map_state != IsUnmapped;
+    if (c.position.x != attrs.x || c.position.y != attrs.y || c.size.width != attrs.width || c.size.height != attrs.height ||
+        c.border_width != attrs.border_width || c.mapped != mapped || c.override_redirect != static_cast<bool>(attrs.override_redirect)) {
+        cerr << "Window cache drift for " << w << ": cached " << c.position << " " << c.size << " border " << c.border_width
+             << " mapped " << c.mapped << ", server " << Position<int>(attrs.x, attrs.y) << " " << Size<int>(attrs.width, attrs.height)
+             << " border " << attrs.border_width << " mapped " << mapped << endl;
+    }
+}
 
 int WindowManager::OnXError(Display* display, XErrorEvent *e) {
+    ++x_errors_;
     const int MAX_ERROR_TEXT_LENGTH = 1024;
     char error_text[MAX_ERROR_TEXT_LENGTH];
     XGetErrorText(display, e->error_code, error_text, sizeof(error_text));
@@ -312,30 +1322,3 @@ int WindowManager::OnWMDetected(Display* display, XErrorEvent *e) {
     wm_detected_ = true;
     return 0;
 }
-
-int WindowManager::execute(char *s)
-{
-    cout << "inside execute:" << endl;
-    int status, pid, w;
-    void (*istat)(int), (*qstat)(int);
-    if ((pid = vfork()) == 0) {
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGHUP, SIG_DFL);
-        execl("/bin/sh", "sh", "-c", s, 0);
-        _exit(127);
-    }
-    istat = signal(SIGINT, SIG_IGN);
-    qstat = signal(SIGQUIT, SIG_IGN);
-    while ((w = wait(&status)) != pid && w != -1)
-    {
-        ;
-    }
-    if (w == -1)
-    {
-        status = -1;
-    }
-    signal(SIGINT, istat);
-    signal(SIGQUIT, qstat);
-    return(status);
-}
@@ -1,25 +1,72 @@
 #ifndef WINMAN_HPP
 #define WINMAN_HPP
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include "atoms.hpp"
+#include "bindings.hpp"
+#include "clientstore.hpp"
+#include "compositor.hpp"
+#include "control.hpp"
+#include "eventloop.hpp"
 #include "eventnames.hpp"
+#include "ewmh.hpp"
+#include "launcher.hpp"
+#include "layout.hpp"
+#include "metrics.hpp"
+#include "record.hpp"
+#include "roundtrip.hpp"
+#include "snapindex.hpp"
+#include "trace.hpp"
+#include "xbatch.hpp"
+#include "xconnection.hpp"
 extern "C" {
 #include <X11/Xlib.h>
+#include <X11/extensions/sync.h>
 }
 using namespace std;
+
 class WindowManager {
 	public:
 		static unique_ptr<WindowManager> Create(const string& display_str = string());
+		// Runs against any connection, e.g. a FakeXServer for benchmarks.
+		static unique_ptr<WindowManager> Create(unique_ptr<XConnection> connection);
 		~WindowManager();
 		void Run();
+		// Publishes the EWMH root properties, as Run does once it owns the
+		// display. For driving the handlers without Run.
+		void StartEwmh();
+		// Handles one event the way Run does, layout included, without
+		// reading it from the connection.
+		void HandleEvent(XEvent& event);
+		// The same for a batch, with one property refresh and one layout
+		// pass at the end, as for everything one read returns.
+		void HandleEvents(vector<XEvent>& events);
+		// Feeds a recording made with LIGHTWM_RECORD through the event
+		// handlers as fast as possible, without taking over the display,
+		// and prints handler time per event type as JSON.
+		bool Replay(const string& path);
 
 	private:
-		WindowManager(Display* display);
-		void Frame(Window window);
+		WindowManager(unique_ptr<XConnection> connection, const AtomRegistry& atoms);
+		void InitScreenState();
+		void AdoptExistingWindows();
+		void Frame(const WindowInfo& info);
 		void Unframe(Window window);
+		void GrabKeys();
+		void GrabButtons();
+		Window KeyTarget(const XKeyEvent& event);
+		void CloseClient(Window window);
+		void SetFocusedClient(Window w);
+		void CycleFocus(Window target, bool forward);
+		void EndFocusCycle();
+		size_t ApplyLayout();
+		string OnControlCommand(const vector<string>& words);
+		string FormatMetrics() const;
 		
         
         	void OnCreateNotify(const XCreateWindowEvent& event);
@@ -27,6 +74,8 @@ class WindowManager {
 		void OnReparentNotify(const XReparentEvent& event);
 		void OnKeyPress(const XKeyEvent& event);
 		void OnKeyRelease(const XKeyEvent& event);
+		void OnMappingNotify(XMappingEvent& event);
+		void OnFocusIn(const XFocusChangeEvent& event);
 		void OnMapNotify(const XMapEvent& event);
 		void OnUnmapNotify(const XUnmapEvent& event);
 		void OnConfigureNotify(const XConfigureEvent& event);
@@ -35,20 +84,114 @@ class WindowManager {
 		void OnButtonPress(const XButtonEvent& event);
 		void OnButtonRelease(const XButtonEvent& event);
 		void OnMotionNotify(const XMotionEvent& event);
-        	int execute(char *s);
+		void OnPropertyNotify(const XPropertyEvent& event);
+		void RefreshProperties();
+		void DrawOutline();
+		bool StartSyncResize(const Client& client);
+		void SendSyncRequest(Time time);
+		void OnSyncAlarm(const XSyncAlarmNotifyEvent& event);
+		void EndSyncResize();
+		void CoalesceMotion(XEvent* event);
+		void FlushMotion();
+		void UpdateMotionTimer();
+		void OnMotionTimer();
+		void ProcessXEvents();
+		void DispatchEvent(XEvent& event);
+		CachedWindow* CachedGeometry(Window w);
+		void UpdateSnapIndex(const Client& client);
+		Position<int> SnapFrame(const Position<int>& position);
+		void CheckCachedWindow(Window w);
 		static int OnXError(Display* display, XErrorEvent* event);
+		static unsigned long x_errors_;
+		static int OnReplayXError(Display* display, XErrorEvent* event);
 		static int OnWMDetected(Display* display, XErrorEvent* event);
 		static bool wm_detected_;
         	static mutex wm_detected_mutex_;
-		Display* display_handle;
+		unique_ptr<XConnection> connection_;
+		/* connection_ itself when LIGHTWM_AUDIT_ROUND_TRIPS is set, else
+		 * nullptr. */
+		AuditingConnection* audit_;
 		const Window root_handle;
-		unordered_map<Window, Window> clients_handle;
+		ClientStore clients_handle;
+		KeyBindings key_bindings_;
+		Launcher launcher_;
+		/* WindowProperty bits of clients' properties changed since the
+		 * last RefreshProperties. */
+		unordered_map<Window, unsigned int> stale_properties_;
+		/* Windows that are neither clients nor frames. */
+		unordered_map<Window, CachedWindow> window_cache_;
+		unsigned long cache_check_interval_;
+		unsigned long events_since_cache_check_;
+		/* Mapped frames by edge, for snapping moves to within
+		 * snap_distance_ pixels (LIGHTWM_SNAP_DISTANCE, 0 turns it off). */
+		SnapIndex snap_index_;
+		int snap_distance_;
 		Position<int> drag_start_pos_;
 		Position<int> drag_start_frame_pos_;
 		Size<int> drag_start_frame_size_;
 
+		/* Frame-paced drag/resize: the newest motion event is held back and
+		 * applied at most once per motion_interval_. */
+		chrono::milliseconds motion_interval_;
+		chrono::steady_clock::time_point next_motion_flush_;
+		bool motion_pending_;
+		XMotionEvent pending_motion_;
+		unsigned long motion_events_received_;
+		unsigned long motion_requests_issued_;
+		/* LIGHTWM_LAYOUT=tile: clients are placed by layout_ instead of
+		 * floating where they ask to be. */
+		bool tiling_;
+		TilingLayout layout_;
+		Window drag_frame_;
+		Window drag_client_;
+		/* How the current drag is applied, see ResizeMode. New clients get
+		 * default_resize_mode_ (LIGHTWM_RESIZE_MODE). */
+		ResizeMode default_resize_mode_;
+		ResizeMode drag_mode_;
+		bool outline_visible_;
+		Position<int> outline_pos_;
+		Size<int> outline_size_;
+		/* _NET_WM_SYNC_REQUEST state of the client being resized. At most one
+		 * resize is outstanding; newer motion waits in sync_deferred_motion_
+		 * until the alarm on the client's counter fires or the deadline passes. */
+		bool sync_available_;
+		int sync_event_base_;
+		XSyncCounter sync_counter_;
+		XSyncAlarm sync_alarm_;
+		int64_t sync_value_;
+		bool sync_pending_;
+		chrono::steady_clock::time_point sync_deadline_;
+		bool sync_deferred_;
+		XMotionEvent sync_deferred_motion_;
+		Window focused_client_;
+		/* _NET_CLIENT_LIST and friends on the root window, from Run on. */
+		Ewmh ewmh_;
+		/* ALT+Tab walks focus_cursor_ through the ring while Alt is held
+		 * and only reorders the ring when Alt is released. */
+		bool cycling_focus_;
+		Window focus_cursor_;
+		/* Totals for the stats control command. */
+		unsigned long events_dispatched_;
+		unsigned long first_request_;
+		chrono::nanoseconds dispatch_time_;
+		/* Handler latency histograms, served on the metrics socket and
+		 * dumped to stderr on SIGUSR1. */
+		Metrics metrics_;
+		/* LIGHTWM_RECORD: every event read, coalesced motion included, for
+		 * replay. */
+		EventRecorder recorder_;
+		EventLoop event_loop_;
+		int motion_timer_;
+		int signal_fd_;
+		unique_ptr<ControlServer> control_;
+		unique_ptr<MetricsServer> metrics_server_;
+#if LIGHTWM_TRACE_LEVEL >= TRACE_LEVEL_EVENTS
+		Tracer tracer_;
+#endif
+#ifdef LIGHTWM_COMPOSITOR
+		unique_ptr<Compositor> compositor_;
+#endif
 
-		const Atom WM_PROTOCOLS;
-		const Atom WM_DELETE_WINDOW;
+		const AtomRegistry atoms_;
 };
 #endif
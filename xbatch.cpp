@@ -0,0 +1,350 @@
+#include "xbatch.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+extern "C" {
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#ifdef LIGHTWM_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif
+}
+using namespace std;
+
+/* The cached properties by bit number, and the most of each that is read,
+ * in 32-bit units. */
+static const int PROPERTY_COUNT = 7;
+static const long PROPERTY_LENGTHS[PROPERTY_COUNT] = {64, 256, 256, 256, 18, 9, 1};
+
+Atom PropertyAtom(unsigned int bit, const AtomRegistry& atoms) {
+    switch (bit) {
+        case PROPERTY_PROTOCOLS: return atoms[AtomId::WM_PROTOCOLS];
+        case PROPERTY_CLASS: return XA_WM_CLASS;
+        case PROPERTY_NAME: return XA_WM_NAME;
+        case PROPERTY_NET_NAME: return atoms[AtomId::NET_WM_NAME];
+        case PROPERTY_NORMAL_HINTS: return XA_WM_NORMAL_HINTS;
+        case PROPERTY_HINTS: return XA_WM_HINTS;
+        default: return XA_WM_TRANSIENT_FOR;
+    }
+}
+
+unsigned int PropertyBit(Atom property, const AtomRegistry& atoms) {
+    switch (property) {
+        case XA_WM_CLASS: return PROPERTY_CLASS;
+        case XA_WM_NAME: return PROPERTY_NAME;
+        case XA_WM_NORMAL_HINTS: return PROPERTY_NORMAL_HINTS;
+        case XA_WM_HINTS: return PROPERTY_HINTS;
+        case XA_WM_TRANSIENT_FOR: return PROPERTY_TRANSIENT_FOR;
+    }
+    AtomId id;
+    if (!atoms.Find(property, &id)) {
+        return 0;
+    }
+    switch (id) {
+        case AtomId::WM_PROTOCOLS: return PROPERTY_PROTOCOLS;
+        case AtomId::NET_WM_NAME: return PROPERTY_NET_NAME;
+        default: return 0;
+    }
+}
+
+bool WindowProperties::Supports(Atom protocol) const {
+    return find(protocols.begin(), protocols.end(), protocol) != protocols.end();
+}
+
+/* Splits a WM_CLASS value ("name\0class\0") into its two strings. */
+static void ParseClass(const char* value, size_t length, WindowProperties* properties) {
+    const char* end = value + length;
+    const char* name_end = static_cast<const char*>(memchr(value, '\0', length));
+    if (name_end == nullptr) {
+        properties->res_name.assign(value, end);
+        return;
+    }
+    properties->res_name.assign(value, name_end);
+    const char* class_start = name_end + 1;
+    const char* class_end = class_start < end ? static_cast<const char*>(memchr(class_start, '\0', end - class_start)) : nullptr;
+    properties->res_class.assign(class_start, class_end ? class_end : end);
+}
+
+static unsigned long Item(const void* data, size_t i, size_t item_size) {
+    if (item_size == 4) {
+        uint32_t value;
+        memcpy(&value, static_cast<const char*>(data) + 4 * i, 4);
+        return value;
+    }
+    return static_cast<const unsigned long*>(data)[i];
+}
+
+/* WM_NORMAL_HINTS is 18 CARD32s (15 before ICCCM 1.0 added the base size
+ * and gravity), WM_HINTS 9 (8 before window_group). */
+void ParseProperty(unsigned int bit, int format, const void* data, size_t count, size_t item_size, WindowProperties* properties) {
+    const bool text = format == 8 && data != nullptr;
+    const bool cardinals = format == 32 && data != nullptr;
+    switch (bit) {
+        case PROPERTY_PROTOCOLS:
+            properties->protocols.clear();
+            for (size_t i = 0; cardinals && i < count; ++i) {
+                properties->protocols.push_back(Item(data, i, item_size));
+            }
+            break;
+        case PROPERTY_CLASS:
+            properties->res_name.clear();
+            properties->res_class.clear();
+            if (text) {
+                ParseClass(static_cast<const char*>(data), count, properties);
+            }
+            break;
+        case PROPERTY_NAME:
+        case PROPERTY_NET_NAME: {
+            string& name = bit == PROPERTY_NAME ? properties->name : properties->net_name;
+            name.clear();
+            if (text) {
+                name.assign(static_cast<const char*>(data), count);
+            }
+            break;
+        }
+        case PROPERTY_NORMAL_HINTS: {
+            XSizeHints& hints = properties->normal_hints;
+            hints = XSizeHints();
+            if (!cardinals || count < 15) {
+                break;
+            }
+            long values[18] = {};
+            for (size_t i = 0; i < min<size_t>(count, 18); ++i) {
+                values[i] = Item(data, i, item_size);
+            }
+            hints.flags = values[0];
+            if (count < 18) {
+                hints.flags &= ~(PBaseSize | PWinGravity);
+            }
+            hints.x = values[1];
+            hints.y = values[2];
+            hints.width = values[3];
+            hints.height = values[4];
+            hints.min_width = values[5];
+            hints.min_height = values[6];
+            hints.max_width = values[7];
+            hints.max_height = values[8];
+            hints.width_inc = values[9];
+            hints.height_inc = values[10];
+            hints.min_aspect.x = values[11];
+            hints.min_aspect.y = values[12];
+            hints.max_aspect.x = values[13];
+            hints.max_aspect.y = values[14];
+            hints.base_width = values[15];
+            hints.base_height = values[16];
+            hints.win_gravity = values[17];
+            break;
+        }
+        case PROPERTY_HINTS: {
+            XWMHints& hints = properties->hints;
+            hints = XWMHints();
+            if (!cardinals || count < 8) {
+                break;
+            }
+            hints.flags = Item(data, 0, item_size);
+            if (count < 9) {
+                hints.flags &= ~WindowGroupHint;
+            }
+            hints.input = Item(data, 1, item_size);
+            hints.initial_state = Item(data, 2, item_size);
+            hints.icon_pixmap = Item(data, 3, item_size);
+            hints.icon_window = Item(data, 4, item_size);
+            hints.icon_x = Item(data, 5, item_size);
+            hints.icon_y = Item(data, 6, item_size);
+            hints.icon_mask = Item(data, 7, item_size);
+            hints.window_group = count < 9 ? None : Item(data, 8, item_size);
+            break;
+        }
+        case PROPERTY_TRANSIENT_FOR:
+            properties->transient_for = cardinals && count >= 1 ? Item(data, 0, item_size) : None;
+            break;
+    }
+}
+
+#ifdef LIGHTWM_XCB
+
+/* Reads one property reply into its place in properties. */
+static void ReadProperty(xcb_connection_t* c, xcb_get_property_cookie_t cookie, int index, WindowProperties* properties) {
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(c, cookie, nullptr);
+    if (reply == nullptr) {
+        ParseProperty(1u << index, 0, nullptr, 0, 4, properties);
+        return;
+    }
+    const int format = reply->format;
+    const size_t count = format ? xcb_get_property_value_length(reply) / (format / 8) : 0;
+    ParseProperty(1u << index, format, xcb_get_property_value(reply), count, 4, properties);
+    free(reply);
+}
+
+vector<WindowInfo> FetchWindowInfo(Display* display, const vector<Window>& windows, const AtomRegistry& atoms) {
+    xcb_connection_t* c = XGetXCBConnection(display);
+    XFlush(display);
+    struct Cookies {
+        xcb_get_window_attributes_cookie_t attributes;
+        xcb_get_geometry_cookie_t geometry;
+        xcb_get_property_cookie_t properties[PROPERTY_COUNT];
+    };
+    vector<Cookies> cookies(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        const xcb_window_t w = windows[i];
+        cookies[i].attributes = xcb_get_window_attributes(c, w);
+        cookies[i].geometry = xcb_get_geometry(c, w);
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            cookies[i].properties[p] = xcb_get_property(c, 0, w, PropertyAtom(1u << p, atoms), XCB_GET_PROPERTY_TYPE_ANY, 0, PROPERTY_LENGTHS[p]);
+        }
+    }
+    xcb_flush(c);
+
+    vector<WindowInfo> infos(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        WindowInfo& info = infos[i];
+        info.window = windows[i];
+        xcb_get_window_attributes_reply_t* attributes = xcb_get_window_attributes_reply(c, cookies[i].attributes, nullptr);
+        xcb_get_geometry_reply_t* geometry = xcb_get_geometry_reply(c, cookies[i].geometry, nullptr);
+        info.valid = attributes != nullptr && geometry != nullptr;
+        if (info.valid) {
+            info.position = Position<int>(geometry->x, geometry->y);
+            info.size = Size<int>(geometry->width, geometry->height);
+            info.border_width = geometry->border_width;
+            info.mapped = attributes->map_state != XCB_MAP_STATE_UNMAPPED;
+            info.override_redirect = attributes->override_redirect;
+            info.visual = attributes->visual;
+        }
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            ReadProperty(c, cookies[i].properties[p], p, &info.properties);
+        }
+        free(attributes);
+        free(geometry);
+    }
+    return infos;
+}
+
+void FetchProperties(Display* display, const vector<PropertyFetch>& fetches, const AtomRegistry& atoms) {
+    xcb_connection_t* c = XGetXCBConnection(display);
+    XFlush(display);
+    vector<xcb_get_property_cookie_t> cookies;
+    for (const PropertyFetch& fetch : fetches) {
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            if (fetch.properties & (1u << p)) {
+                cookies.push_back(xcb_get_property(c, 0, fetch.window, PropertyAtom(1u << p, atoms), XCB_GET_PROPERTY_TYPE_ANY, 0, PROPERTY_LENGTHS[p]));
+            }
+        }
+    }
+    xcb_flush(c);
+    size_t next = 0;
+    for (const PropertyFetch& fetch : fetches) {
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            if (fetch.properties & (1u << p)) {
+                ReadProperty(c, cookies[next++], p, fetch.into);
+            }
+        }
+    }
+}
+
+bool QueryChildren(Display* display, Window window, vector<Window>* children) {
+    xcb_connection_t* c = XGetXCBConnection(display);
+    XFlush(display);
+    xcb_query_tree_reply_t* tree = xcb_query_tree_reply(c, xcb_query_tree(c, window), nullptr);
+    if (tree == nullptr) {
+        return false;
+    }
+    const xcb_window_t* first = xcb_query_tree_children(tree);
+    children->assign(first, first + xcb_query_tree_children_length(tree));
+    free(tree);
+    return true;
+}
+
+vector<Atom> InternAtoms(Display* display, const vector<string>& names) {
+    xcb_connection_t* c = XGetXCBConnection(display);
+    XFlush(display);
+    vector<xcb_intern_atom_cookie_t> cookies;
+    cookies.reserve(names.size());
+    for (const string& name : names) {
+        cookies.push_back(xcb_intern_atom(c, 0, name.size(), name.c_str()));
+    }
+    vector<Atom> atoms;
+    atoms.reserve(names.size());
+    for (const xcb_intern_atom_cookie_t& cookie : cookies) {
+        xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(c, cookie, nullptr);
+        atoms.push_back(reply ? reply->atom : None);
+        free(reply);
+    }
+    return atoms;
+}
+
+#else
+
+static void FetchProperty(Display* display, Window w, int index, const AtomRegistry& atoms, WindowProperties* properties) {
+    Atom type;
+    int format = 0;
+    unsigned long count = 0, remaining;
+    unsigned char* data = nullptr;
+    if (XGetWindowProperty(display, w, PropertyAtom(1u << index, atoms), 0, PROPERTY_LENGTHS[index], False, AnyPropertyType,
+                           &type, &format, &count, &remaining, &data) != Success) {
+        format = 0;
+        count = 0;
+    }
+    ParseProperty(1u << index, format, data, count, sizeof(long), properties);
+    if (data != nullptr) {
+        XFree(data);
+    }
+}
+
+vector<WindowInfo> FetchWindowInfo(Display* display, const vector<Window>& windows, const AtomRegistry& atoms) {
+    vector<WindowInfo> infos(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        WindowInfo& info = infos[i];
+        info.window = windows[i];
+        XWindowAttributes attrs;
+        info.valid = XGetWindowAttributes(display, windows[i], &attrs);
+        if (!info.valid) {
+            continue;
+        }
+        info.position = Position<int>(attrs.x, attrs.y);
+        info.size = Size<int>(attrs.width, attrs.height);
+        info.border_width = attrs.border_width;
+        info.mapped = attrs.map_state != IsUnmapped;
+        info.override_redirect = attrs.override_redirect;
+        info.visual = XVisualIDFromVisual(attrs.visual);
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            FetchProperty(display, windows[i], p, atoms, &info.properties);
+        }
+    }
+    return infos;
+}
+
+void FetchProperties(Display* display, const vector<PropertyFetch>& fetches, const AtomRegistry& atoms) {
+    for (const PropertyFetch& fetch : fetches) {
+        for (int p = 0; p < PROPERTY_COUNT; ++p) {
+            if (fetch.properties & (1u << p)) {
+                FetchProperty(display, fetch.window, p, atoms, fetch.into);
+            }
+        }
+    }
+}
+
+bool QueryChildren(Display* display, Window window, vector<Window>* children) {
+    Window returned_root, returned_parent;
+    Window* windows;
+    unsigned int num_windows;
+    if (!XQueryTree(display, window, &returned_root, &returned_parent, &windows, &num_windows)) {
+        return false;
+    }
+    children->assign(windows, windows + num_windows);
+    XFree(windows);
+    return true;
+}
+
+vector<Atom> InternAtoms(Display* display, const vector<string>& names) {
+    vector<char*> c_names;
+    for (const string& name : names) {
+        c_names.push_back(const_cast<char*>(name.c_str()));
+    }
+    vector<Atom> atoms(names.size(), None);
+    XInternAtoms(display, c_names.data(), c_names.size(), false, atoms.data());
+    return atoms;
+}
+
+#endif
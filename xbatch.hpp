@@ -0,0 +1,93 @@
+#ifndef XBATCH_HPP
+#define XBATCH_HPP
+#include <string>
+#include <vector>
+#include "atoms.hpp"
+#include "eventnames.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+}
+
+/* Batched server queries. Built with LIGHTWM_XCB (scons backend=xcb, the
+ * default) every request of a batch is sent before the first reply is read,
+ * so a batch costs one round trip. The Xlib build issues the same queries
+ * one blocking call at a time and is kept for comparison. */
+
+// The client properties the WM keeps a copy of, one bit each. A
+// PropertyNotify refreshes only the bit of the property it names.
+enum WindowProperty : unsigned int {
+	PROPERTY_PROTOCOLS = 1 << 0,
+	PROPERTY_CLASS = 1 << 1,
+	PROPERTY_NAME = 1 << 2,
+	PROPERTY_NET_NAME = 1 << 3,
+	PROPERTY_NORMAL_HINTS = 1 << 4,
+	PROPERTY_HINTS = 1 << 5,
+	PROPERTY_TRANSIENT_FOR = 1 << 6,
+	ALL_PROPERTIES = (1 << 7) - 1,
+};
+
+// ICCCM and EWMH properties of a client, as last fetched. Unset ones are
+// empty, None or have no flags.
+struct WindowProperties {
+	std::vector<Atom> protocols;
+	std::string res_name;
+	std::string res_class;
+	// WM_NAME as sent (STRING, usually) and _NET_WM_NAME (UTF-8).
+	std::string name;
+	std::string net_name;
+	XSizeHints normal_hints = XSizeHints();
+	XWMHints hints = XWMHints();
+	Window transient_for = None;
+
+	// What a title bar would show: _NET_WM_NAME if set, else WM_NAME.
+	const std::string& title() const { return net_name.empty() ? name : net_name; }
+	bool Supports(Atom protocol) const;
+};
+
+// The property atom of a WindowProperty bit, and the bit of an atom (0 if
+// it is not cached).
+Atom PropertyAtom(unsigned int bit, const AtomRegistry& atoms);
+unsigned int PropertyBit(Atom property, const AtomRegistry& atoms);
+
+// Replaces the properties in bit with a GetProperty reply (any of the
+// ALL_PROPERTIES bits, one at a time). Format 32 items are item_size bytes
+// each: 4 on the wire (XCB), sizeof(long) from Xlib. A missing or
+// malformed property clears the cached one.
+void ParseProperty(unsigned int bit, int format, const void* data, size_t count, size_t item_size, WindowProperties* properties);
+
+// Everything the WM wants to know about a window before framing it.
+struct WindowInfo {
+	Window window;
+	bool valid;
+	Position<int> position;
+	Size<int> size;
+	int border_width;
+	bool mapped;
+	bool override_redirect;
+	// The window's visual, for picture formats; 0 if the backend does not
+	// report one.
+	VisualID visual;
+	WindowProperties properties;
+};
+
+// Fetches attributes, geometry and all cached properties of every window.
+// Windows that vanished come back with valid == false.
+std::vector<WindowInfo> FetchWindowInfo(Display* display, const std::vector<Window>& windows, const AtomRegistry& atoms);
+
+// Properties to fetch again: the bits in properties, of window, into into.
+struct PropertyFetch {
+	Window window;
+	unsigned int properties;
+	WindowProperties* into;
+};
+
+// Refreshes all fetches together.
+void FetchProperties(Display* display, const std::vector<PropertyFetch>& fetches, const AtomRegistry& atoms);
+
+// Returns the children of window in stacking order.
+bool QueryChildren(Display* display, Window window, std::vector<Window>* children);
+
+// Interns all names at once, in order.
+std::vector<Atom> InternAtoms(Display* display, const std::vector<std::string>& names);
+#endif
@@ -0,0 +1,120 @@
+#include "xconnection.hpp"
+extern "C" {
+#include <X11/XKBlib.h>
+#include <X11/Xatom.h>
+}
+using namespace std;
+
+XlibConnection::XlibConnection(Display* display) :
+    display_(display),
+    outline_gc_(nullptr) {
+}
+
+XlibConnection::~XlibConnection() {
+    if (outline_gc_ != nullptr) {
+        XFreeGC(display_, outline_gc_);
+    }
+    XCloseDisplay(display_);
+}
+
+Size<int> XlibConnection::screen_size() const {
+    const int screen = DefaultScreen(display_);
+    return Size<int>(DisplayWidth(display_, screen), DisplayHeight(display_, screen));
+}
+
+bool XlibConnection::CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) {
+    return XCheckIfEvent(display_, event, predicate, arg);
+}
+
+Window XlibConnection::CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+                                    unsigned int border_width, unsigned long border, unsigned long background) {
+    return XCreateSimpleWindow(display_, parent, x, y, width, height, border_width, border, background);
+}
+
+void XlibConnection::ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) {
+    XWindowChanges copy = changes;
+    XConfigureWindow(display_, w, value_mask, &copy);
+}
+
+bool XlibConnection::SendEvent(Window w, const XEvent& event) {
+    XEvent copy = event;
+    return XSendEvent(display_, w, False, NoEventMask, &copy);
+}
+
+bool XlibConnection::GetCardinalProperty(Window w, Atom property, unsigned long* value) {
+    Atom type;
+    int format;
+    unsigned long count, remaining;
+    unsigned char* data = nullptr;
+    if (XGetWindowProperty(display_, w, property, 0, 1, False, XA_CARDINAL,
+                           &type, &format, &count, &remaining, &data) != Success || data == nullptr) {
+        return false;
+    }
+    const bool found = count == 1 && format == 32;
+    if (found) {
+        *value = *reinterpret_cast<unsigned long*>(data);
+    }
+    XFree(data);
+    return found;
+}
+
+bool XlibConnection::GrabKeyboard() {
+    return XGrabKeyboard(display_, root(), False, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess;
+}
+
+void XlibConnection::GrabKey(KeyCode keycode, unsigned int modifiers) {
+    XGrabKey(display_, keycode, modifiers, root(), False, GrabModeAsync, GrabModeAsync);
+}
+
+void XlibConnection::GrabButton(unsigned int button, unsigned int modifiers, unsigned int event_mask) {
+    XGrabButton(display_, button, modifiers, root(), False, event_mask, GrabModeAsync, GrabModeAsync, None, None);
+}
+
+KeySym XlibConnection::KeycodeToKeysym(KeyCode keycode) {
+    return XkbKeycodeToKeysym(display_, keycode, 0, 0);
+}
+
+void XlibConnection::DrawOutline(int x, int y, unsigned int width, unsigned int height) {
+    if (outline_gc_ == nullptr) {
+        /* Inverting draws the outline and drawing it again erases it. */
+        const int screen = DefaultScreen(display_);
+        XGCValues outline;
+        outline.function = GXxor;
+        outline.foreground = WhitePixel(display_, screen) ^ BlackPixel(display_, screen);
+        outline.subwindow_mode = IncludeInferiors;
+        outline.line_width = 2;
+        outline_gc_ = XCreateGC(display_, root(), GCFunction | GCForeground | GCSubwindowMode | GCLineWidth, &outline);
+    }
+    XDrawRectangle(display_, root(), outline_gc_, x, y, width, height);
+}
+
+bool XlibConnection::QuerySync(int* event_base) {
+    int error_base, major, minor;
+    return XSyncQueryExtension(display_, event_base, &error_base) && XSyncInitialize(display_, &major, &minor);
+}
+
+bool XlibConnection::QueryCounter(XSyncCounter counter, int64_t* value) {
+    XSyncValue v;
+    if (!XSyncQueryCounter(display_, counter, &v)) {
+        return false;
+    }
+    *value = (static_cast<int64_t>(XSyncValueHigh32(v)) << 32) | XSyncValueLow32(v);
+    return true;
+}
+
+XSyncAlarm XlibConnection::CreateAlarm(XSyncCounter counter, int64_t value) {
+    XSyncAlarmAttributes alarm;
+    alarm.trigger.counter = counter;
+    alarm.trigger.value_type = XSyncAbsolute;
+    alarm.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntsToValue(&alarm.trigger.wait_value, static_cast<unsigned int>(value), static_cast<int>(value >> 32));
+    XSyncIntToValue(&alarm.delta, 0);
+    alarm.events = True;
+    return XSyncCreateAlarm(display_, XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue | XSyncCADelta | XSyncCAEvents, &alarm);
+}
+
+void XlibConnection::ChangeAlarm(XSyncAlarm alarm, int64_t value) {
+    XSyncAlarmAttributes attributes;
+    XSyncIntsToValue(&attributes.trigger.wait_value, static_cast<unsigned int>(value), static_cast<int>(value >> 32));
+    XSyncChangeAlarm(display_, alarm, XSyncCAValue, &attributes);
+}
@@ -0,0 +1,186 @@
+#ifndef XCONNECTION_HPP
+#define XCONNECTION_HPP
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "eventnames.hpp"
+#include "xbatch.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/extensions/sync.h>
+}
+
+// Everything the window manager asks of the X server. The handlers never
+// touch a Display directly, so they run the same against XlibConnection
+// (a real server) and FakeXServer (an in-memory model, see fakexserver.hpp).
+// Requests are buffered as in Xlib; only the queries wait for an answer.
+class XConnection {
+	public:
+		virtual ~XConnection() {}
+
+		// The Xlib display behind the connection, or nullptr when there is
+		// no server (the compositor and error handlers need the real thing).
+		virtual Display* display() = 0;
+		virtual std::string name() const = 0;
+		virtual Window root() const = 0;
+		virtual Size<int> screen_size() const = 0;
+		// File descriptor to poll for events, -1 if there is none.
+		virtual int fd() const = 0;
+		// Serial of the next request, for counting requests.
+		virtual unsigned long NextRequestSerial() = 0;
+		virtual void Flush() = 0;
+		virtual void Sync() = 0;
+		// True if a batched query (FetchWindowInfo, FetchProperties) waits
+		// for all its replies at once, false if it waits for each in turn.
+		virtual bool pipelined() const = 0;
+
+		// Event queue, as XPending, XNextEvent, XCheckIfEvent and
+		// XEventsQueued(QueuedAlready).
+		virtual int Pending() = 0;
+		virtual void NextEvent(XEvent* event) = 0;
+		virtual bool CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) = 0;
+		virtual int QueuedEvents() = 0;
+
+		// Windows.
+		virtual Window CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+		                            unsigned int border_width, unsigned long border, unsigned long background) = 0;
+		virtual void DestroyWindow(Window w) = 0;
+		virtual void MapWindow(Window w) = 0;
+		virtual void UnmapWindow(Window w) = 0;
+		virtual void ReparentWindow(Window w, Window parent, int x, int y) = 0;
+		virtual void ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) = 0;
+		virtual void MoveWindow(Window w, int x, int y) = 0;
+		virtual void ResizeWindow(Window w, unsigned int width, unsigned int height) = 0;
+		virtual void MoveResizeWindow(Window w, int x, int y, unsigned int width, unsigned int height) = 0;
+		virtual void RaiseWindow(Window w) = 0;
+		virtual void SelectInput(Window w, long event_mask) = 0;
+		virtual void AddToSaveSet(Window w) = 0;
+		virtual void RemoveFromSaveSet(Window w) = 0;
+		virtual void SetInputFocus(Window w) = 0;
+		virtual bool SendEvent(Window w, const XEvent& event) = 0;
+		virtual void KillClient(Window w) = 0;
+		// As XChangeProperty: mode is PropModeReplace, PropModeAppend or
+		// PropModePrepend, and format 32 data is an array of longs.
+		virtual void ChangeProperty(Window w, Atom property, Atom type, int format, int mode, const void* data, int count) = 0;
+
+		// Queries.
+		virtual std::vector<WindowInfo> FetchWindowInfo(const std::vector<Window>& windows, const AtomRegistry& atoms) = 0;
+		virtual void FetchProperties(const std::vector<PropertyFetch>& fetches, const AtomRegistry& atoms) = 0;
+		virtual bool QueryChildren(Window w, std::vector<Window>* children) = 0;
+		virtual std::vector<Atom> InternAtoms(const std::vector<std::string>& names) = 0;
+		virtual bool GetWindowAttributes(Window w, XWindowAttributes* attributes) = 0;
+		// A single 32-bit CARDINAL property value.
+		virtual bool GetCardinalProperty(Window w, Atom property, unsigned long* value) = 0;
+
+		// Grabs.
+		virtual void GrabServer() = 0;
+		virtual void UngrabServer() = 0;
+		virtual bool GrabKeyboard() = 0;
+		virtual void UngrabKeyboard() = 0;
+		virtual void GrabKey(KeyCode keycode, unsigned int modifiers) = 0;
+		virtual void UngrabAllKeys() = 0;
+		virtual void GrabButton(unsigned int button, unsigned int modifiers, unsigned int event_mask) = 0;
+
+		// Keyboard mapping.
+		virtual KeyCode KeysymToKeycode(KeySym keysym) = 0;
+		virtual KeySym KeycodeToKeysym(KeyCode keycode) = 0;
+		virtual void RefreshKeyboardMapping(XMappingEvent* event) = 0;
+
+		// Draws, or erases when drawn again, an inverted rectangle on the root
+		// window (the outline of an outline-mode drag).
+		virtual void DrawOutline(int x, int y, unsigned int width, unsigned int height) = 0;
+
+		// SYNC extension. QuerySync returns false when the server lacks it.
+		virtual bool QuerySync(int* event_base) = 0;
+		virtual bool QueryCounter(XSyncCounter counter, int64_t* value) = 0;
+		virtual XSyncAlarm CreateAlarm(XSyncCounter counter, int64_t value) = 0;
+		virtual void ChangeAlarm(XSyncAlarm alarm, int64_t value) = 0;
+		virtual void DestroyAlarm(XSyncAlarm alarm) = 0;
+};
+
+// A real server, through Xlib (and XCB for the batched queries).
+class XlibConnection : public XConnection {
+	public:
+		// Takes ownership of display and closes it on destruction.
+		explicit XlibConnection(Display* display);
+		~XlibConnection() override;
+
+		Display* display() override { return display_; }
+		std::string name() const override { return XDisplayString(display_); }
+		Window root() const override { return DefaultRootWindow(display_); }
+		Size<int> screen_size() const override;
+		int fd() const override { return ConnectionNumber(display_); }
+		unsigned long NextRequestSerial() override { return NextRequest(display_); }
+		void Flush() override { XFlush(display_); }
+		void Sync() override { XSync(display_, False); }
+#ifdef LIGHTWM_XCB
+		bool pipelined() const override { return true; }
+#else
+		bool pipelined() const override { return false; }
+#endif
+
+		int Pending() override { return XPending(display_); }
+		void NextEvent(XEvent* event) override { XNextEvent(display_, event); }
+		bool CheckIfEvent(XEvent* event, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg) override;
+		int QueuedEvents() override { return XEventsQueued(display_, QueuedAlready); }
+
+		Window CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height,
+		                    unsigned int border_width, unsigned long border, unsigned long background) override;
+		void DestroyWindow(Window w) override { XDestroyWindow(display_, w); }
+		void MapWindow(Window w) override { XMapWindow(display_, w); }
+		void UnmapWindow(Window w) override { XUnmapWindow(display_, w); }
+		void ReparentWindow(Window w, Window parent, int x, int y) override { XReparentWindow(display_, w, parent, x, y); }
+		void ConfigureWindow(Window w, unsigned int value_mask, const XWindowChanges& changes) override;
+		void MoveWindow(Window w, int x, int y) override { XMoveWindow(display_, w, x, y); }
+		void ResizeWindow(Window w, unsigned int width, unsigned int height) override { XResizeWindow(display_, w, width, height); }
+		void MoveResizeWindow(Window w, int x, int y, unsigned int width, unsigned int height) override {
+			XMoveResizeWindow(display_, w, x, y, width, height);
+		}
+		void RaiseWindow(Window w) override { XRaiseWindow(display_, w); }
+		void SelectInput(Window w, long event_mask) override { XSelectInput(display_, w, event_mask); }
+		void AddToSaveSet(Window w) override { XAddToSaveSet(display_, w); }
+		void RemoveFromSaveSet(Window w) override { XRemoveFromSaveSet(display_, w); }
+		void SetInputFocus(Window w) override { XSetInputFocus(display_, w, RevertToPointerRoot, CurrentTime); }
+		bool SendEvent(Window w, const XEvent& event) override;
+		void KillClient(Window w) override { XKillClient(display_, w); }
+		void ChangeProperty(Window w, Atom property, Atom type, int format, int mode, const void* data, int count) override {
+			XChangeProperty(display_, w, property, type, format, mode, static_cast<const unsigned char*>(data), count);
+		}
+
+		std::vector<WindowInfo> FetchWindowInfo(const std::vector<Window>& windows, const AtomRegistry& atoms) override {
+			return ::FetchWindowInfo(display_, windows, atoms);
+		}
+		void FetchProperties(const std::vector<PropertyFetch>& fetches, const AtomRegistry& atoms) override {
+			::FetchProperties(display_, fetches, atoms);
+		}
+		bool QueryChildren(Window w, std::vector<Window>* children) override { return ::QueryChildren(display_, w, children); }
+		std::vector<Atom> InternAtoms(const std::vector<std::string>& names) override { return ::InternAtoms(display_, names); }
+		bool GetWindowAttributes(Window w, XWindowAttributes* attributes) override { return XGetWindowAttributes(display_, w, attributes); }
+		bool GetCardinalProperty(Window w, Atom property, unsigned long* value) override;
+
+		void GrabServer() override { XGrabServer(display_); }
+		void UngrabServer() override { XUngrabServer(display_); }
+		bool GrabKeyboard() override;
+		void UngrabKeyboard() override { XUngrabKeyboard(display_, CurrentTime); }
+		void GrabKey(KeyCode keycode, unsigned int modifiers) override;
+		void UngrabAllKeys() override { XUngrabKey(display_, AnyKey, AnyModifier, root()); }
+		void GrabButton(unsigned int button, unsigned int modifiers, unsigned int event_mask) override;
+
+		KeyCode KeysymToKeycode(KeySym keysym) override { return XKeysymToKeycode(display_, keysym); }
+		KeySym KeycodeToKeysym(KeyCode keycode) override;
+		void RefreshKeyboardMapping(XMappingEvent* event) override { XRefreshKeyboardMapping(event); }
+
+		void DrawOutline(int x, int y, unsigned int width, unsigned int height) override;
+
+		bool QuerySync(int* event_base) override;
+		bool QueryCounter(XSyncCounter counter, int64_t* value) override;
+		XSyncAlarm CreateAlarm(XSyncCounter counter, int64_t value) override;
+		void ChangeAlarm(XSyncAlarm alarm, int64_t value) override;
+		void DestroyAlarm(XSyncAlarm alarm) override { XSyncDestroyAlarm(display_, alarm); }
+
+	private:
+		Display* display_;
+		// XOR GC for DrawOutline, created on first use.
+		GC outline_gc_;
+};
+#endif